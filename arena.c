@@ -0,0 +1,80 @@
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+void
+arena_init(arena_t *arena)
+{
+    arena->chunks = NULL;
+    arena->current = NULL;
+    arena->allocs = 0;
+}
+
+/*
+ * input: arena - arena to allocate from
+ *        size - bytes needed
+ * output: return memory aligned to 16 bytes, NULL if out of memory
+ */
+void *
+arena_alloc(arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk = arena->current;
+    arena_chunk_t *next;
+    size_t chunk_size;
+    void *ptr;
+
+    size = ARENA_ALIGN(size);
+    if (NULL == chunk || chunk->size - chunk->used < size) {
+        next = chunk ? chunk->next : arena->chunks;
+        if (next && next->size >= size) {
+            // chunk left from before reset
+            chunk = next;
+        } else {
+            chunk_size = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+            next = malloc(sizeof(*next) + chunk_size);
+            if (NULL == next) return NULL;
+            ++arena->allocs;
+            next->size = chunk_size;
+            // free chunks too small for it follow the new one
+            if (chunk) {
+                next->next = chunk->next;
+                chunk->next = next;
+            } else {
+                next->next = arena->chunks;
+                arena->chunks = next;
+            }
+            chunk = next;
+        }
+        chunk->used = 0;
+        arena->current = chunk;
+    }
+
+    ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+/*
+ * input: arena - arena to empty
+ * output: arena - all allocations dropped in O(1), chunks kept for reuse
+ */
+void
+arena_reset(arena_t *arena)
+{
+    arena->current = NULL;
+}
+
+void
+arena_free(arena_t *arena)
+{
+    arena_chunk_t *next;
+
+    while (arena->chunks) {
+        next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->current = NULL;
+}
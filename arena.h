@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// default size of arena chunk, larger allocations get chunks of their own
+#ifndef ARENA_CHUNK
+#define ARENA_CHUNK (64 << 10)
+#endif
+
+typedef struct arena_chunk_s {
+    struct arena_chunk_s *next;
+    size_t size;
+    size_t used;
+    // header is padded so that data is aligned as malloc() memory is
+    _Alignas(16) char data[];
+} arena_chunk_t;
+
+// bump allocator, everything allocated is freed at once,
+// chunks are kept when reset, so reused arena does not call malloc
+typedef struct {
+    // first chunk, chunks are filled in list order
+    arena_chunk_t *chunks;
+    // chunk being allocated from, chunks after it are free
+    arena_chunk_t *current;
+    // chunks allocated since arena_init, for stats
+    unsigned long allocs;
+} arena_t;
+
+void
+arena_init(arena_t *arena);
+
+void *
+arena_alloc(arena_t *arena, size_t size);
+
+void
+arena_reset(arena_t *arena);
+
+void
+arena_free(arena_t *arena);
+
+#endif
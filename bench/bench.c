@@ -0,0 +1,312 @@
+/*
+ * Benchmark of pgn2pdf stages on pgn-file made by gen_pgn.bin,
+ * boards after every ply are checked against its golden checksums.
+ * Games of illegal.pgn must fail to replay at their last move.
+ */
+#define PGN2PDF_NO_MAIN
+#include "../pgn2pdf.c"
+
+#include <time.h>
+
+// stages timed, in order they are run
+enum bench_stage_t {
+    bench_split = 0,
+    bench_index,
+    bench_header,
+    bench_tree,
+    bench_san,
+    bench_print,
+    bench_convert,
+    bench_stages_nr
+};
+
+static const char *bench_stage_names[bench_stages_nr] = {
+    "split", "index", "header", "tree", "san", "print", "convert"
+};
+
+// game of pgn-file with its golden checksums
+typedef struct {
+    char *text;
+    int len;
+    int plies;
+    uint32_t *checksums;
+} bench_game_t;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * input: board - board of pgn2pdf
+ * output: return FNV-1a hash of square letters, as gen_pgn computes it
+ */
+static uint32_t
+board_checksum(const board_t *board)
+{
+    uint32_t hash = 2166136261u;
+    char letter;
+    int i;
+
+    for (i = 0; i < 64; ++i) {
+        letter = square_letters[SQUARE_CODE(board->square[i])];
+        hash = (hash ^ (unsigned char)letter) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * input: name - golden file of gen_pgn.bin
+ *        games, games_nr - games of pgn-file
+ * output: return 0 - ok, -1 - fail (reported)
+ *         games - checksums read
+ */
+static int
+read_golden(const char *name, bench_game_t *games, int games_nr)
+{
+    FILE *in = fopen(name, "r");
+    int k, i;
+
+    if (!in) {
+        fprintf(stderr, "cant open '%s': %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    for (k = 0; k < games_nr; ++k) {
+        if (fscanf(in, "%d", &games[k].plies) != 1) break;
+        games[k].checksums = malloc(sizeof(uint32_t) * (games[k].plies + 1));
+        for (i = 0; i < games[k].plies; ++i)
+            if (fscanf(in, "%x", &games[k].checksums[i]) != 1) break;
+        if (i < games[k].plies) break;
+    }
+    fclose(in);
+
+    if (k < games_nr) {
+        fprintf(stderr, "'%s' has no checksums of game %d\n", name, k);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * input: name - pgn-file with games ending with a move that cannot be made
+ *        ctx - context to replay games with
+ * output: return number of games that replay further or fail earlier
+ *         (reported)
+ */
+static int
+check_illegal(const char *name, game_ctx_t *ctx)
+{
+    pgn_reader_t reader;
+    pgn_move_t *move;
+    char *game;
+    int game_len;
+    int k, plies;
+    int wrong = 0;
+
+    if (pgn_reader_open(&reader, name) == failed) {
+        fprintf(stderr, "cant open '%s'\n", name);
+        return 1;
+    }
+
+    for (k = 0; pgn_reader_next_game(&reader, &game, &game_len) == success; ++k) {
+        verify_game(ctx, game, game_len);
+        for (plies = 0, move = ctx->tree.mainline; move; move = move->next)
+            ++plies;
+        if (ctx->failed_ply == plies && plies > 0)
+            continue;
+
+        ++wrong;
+        if (ctx->failed_ply > 0)
+            fprintf(stderr, "%s game %d: fails at ply %d, not at last ply %d\n",
+                    name, k, ctx->failed_ply, plies);
+        else
+            fprintf(stderr, "%s game %d: replays, its last move must fail\n",
+                    name, k);
+    }
+    pgn_reader_close(&reader);
+
+    return wrong;
+}
+
+int
+main(int argc, char **argv)
+{
+    pgn_reader_t reader;
+    pgn_index_t index;
+    bench_game_t *games = NULL;
+    int games_nr = 0, games_size = 0;
+    game_ctx_t ctx;
+    opening_cache_t openings;
+    // board after every ply of mainline and the move made
+    board_t *boards = NULL;
+    pgn_move_t **moves = NULL;
+    int boards_size = 0;
+    double times[bench_stages_nr] = { 0 };
+    double start, end;
+    long plies = 0;
+    long bytes = 0;
+    int mismatches = 0;
+    int illegal = 0;
+    char *game;
+    int game_len;
+    pgn_move_t *move;
+    move_t parsed;
+    size_t moves_start;
+    int k, ply, i;
+
+    if (argc != 3 && argc != 4) {
+        printf("usage: %s <bench.pgn> <bench.golden> [illegal.pgn]\n"
+               "  times stages of conversion, fails if a board differs from golden\n"
+               "  or if a game of illegal.pgn does not fail at its last move\n",
+               argv[0]);
+        return 1;
+    }
+
+    bb_init();
+    init_zobrist();
+    init_board_template();
+
+    // split: games of pgn-file one by one, as pgn2dir does
+    if (pgn_reader_open(&reader, argv[1]) == failed || !reader.mapped) {
+        fprintf(stderr, "cant map '%s'\n", argv[1]);
+        return 1;
+    }
+    start = now();
+    while (pgn_reader_next_game(&reader, &game, &game_len) == success) {
+        if (games_nr == games_size) {
+            games_size = games_size * 2 + 1024;
+            games = realloc(games, sizeof(bench_game_t) * games_size);
+        }
+        games[games_nr].text = game;
+        games[games_nr].len = game_len;
+        ++games_nr;
+        bytes += game_len;
+    }
+    times[bench_split] = now() - start;
+
+    start = now();
+    if (pgn_index_build(&index, reader.data, reader.len) == failed) {
+        fprintf(stderr, "cant build index\n");
+        return 1;
+    }
+    times[bench_index] = now() - start;
+    pgn_index_free(&index);
+
+    if (read_golden(argv[2], games, games_nr) < 0)
+        return 1;
+
+    init_game_ctx(&ctx);
+    init_opening_cache(&openings);
+    ctx.openings = &openings;
+    ctx.out = &ctx.game_out;
+
+    start = now();
+    for (k = 0; k < games_nr; ++k)
+        pgn_header_parse(&ctx.header, games[k].text, games[k].len);
+    times[bench_header] = now() - start;
+
+    start = now();
+    for (k = 0; k < games_nr; ++k) {
+        pgn_header_parse(&ctx.header, games[k].text, games[k].len);
+        moves_start = ctx.header.movetext;
+        arena_reset(&ctx.arena);
+        pgn_tree_parse(&ctx.tree, &ctx.arena, games[k].text + moves_start,
+                       games[k].len - moves_start);
+    }
+    times[bench_tree] = now() - start;
+
+    // san and print timed game by game, the tree is parsed untimed
+    for (k = 0; k < games_nr; ++k) {
+        pgn_header_parse(&ctx.header, games[k].text, games[k].len);
+        moves_start = ctx.header.movetext;
+        arena_reset(&ctx.arena);
+        pgn_tree_parse(&ctx.tree, &ctx.arena, games[k].text + moves_start,
+                       games[k].len - moves_start);
+
+        if (boards_size < ctx.tree.moves_nr) {
+            boards_size = ctx.tree.moves_nr * 2;
+            boards = realloc(boards, sizeof(board_t) * boards_size);
+            moves = realloc(moves, sizeof(pgn_move_t *) * boards_size);
+        }
+
+        start = now();
+        make_new_board(&ctx.board);
+        for (move = ctx.tree.mainline, ply = 0; move; move = move->next, ++ply) {
+            parse_san(move, &ctx.board, &parsed, move->black);
+            boards[ply] = ctx.board;
+            moves[ply] = move;
+        }
+        end = now();
+        times[bench_san] += end - start;
+
+        if (ply != games[k].plies) {
+            if (mismatches++ < 10)
+                fprintf(stderr, "game %d: %d plies read, golden has %d\n",
+                        k, ply, games[k].plies);
+        } else {
+            for (i = 0; i < ply; ++i) {
+                if (board_checksum(&boards[i]) == games[k].checksums[i])
+                    continue;
+                if (mismatches++ < 10)
+                    fprintf(stderr, "game %d ply %d (%.*s): board differs from golden\n",
+                            k, i + 1, moves[i]->san_len, moves[i]->san);
+                break;
+            }
+        }
+        plies += ply;
+
+        // the same boards printed, without positions repeated
+        ctx.game_out.len = 0;
+        ctx.positions_size = 0;
+        start = now();
+        for (i = 0; i < ply; ++i) {
+            ctx.board = boards[i];
+            ctx.board.real_whites = &ctx.board.whites[1];
+            ctx.board.real_blacks = &ctx.board.blacks[1];
+            print_board(&ctx, "e4 e5", 5, i & 1, i / 2 + 1, NULL);
+        }
+        times[bench_print] += now() - start;
+    }
+
+    // convert: whole games as pgn2pdf converts them
+    start = now();
+    for (k = 0; k < games_nr; ++k) {
+        ctx.k = k;
+        convert_game(&ctx, games[k].text, games[k].len);
+    }
+    times[bench_convert] = now() - start;
+
+    printf("%d games, %ld plies, %ld bytes\n", games_nr, plies, bytes);
+    printf("%-8s %10s %12s %12s\n", "stage", "seconds", "games/s", "plies/s");
+    for (i = 0; i < bench_stages_nr; ++i)
+        printf("%-8s %10.4f %12.0f %12.0f\n", bench_stage_names[i], times[i],
+               times[i] > 0 ? games_nr / times[i] : 0,
+               times[i] > 0 ? plies / times[i] : 0);
+
+    if (argc == 4)
+        illegal = check_illegal(argv[3], &ctx);
+
+    free_game_ctx(&ctx);
+    free_opening_cache(&openings);
+    for (k = 0; k < games_nr; ++k)
+        free(games[k].checksums);
+    free(games);
+    free(boards);
+    free(moves);
+    pgn_reader_close(&reader);
+
+    if (mismatches) {
+        fprintf(stderr, "%d games differ from golden\n", mismatches);
+        return 2;
+    }
+    if (illegal) {
+        fprintf(stderr, "%d games of '%s' do not fail as expected\n", illegal, argv[3]);
+        return 2;
+    }
+    return 0;
+}
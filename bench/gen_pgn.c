@@ -0,0 +1,663 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <stdint.h>
+
+// most moves of one position (218 is the known maximum)
+#define MAX_MOVES 256
+// longest movetext line written
+#define LINE_MAX 79
+
+// set of squares, bit by square, moves are found walking the board
+// square by square so that nothing is shared with bitboard.c under test
+typedef uint64_t squares_t;
+#define SQUARE_BIT(place) ((squares_t)1 << (place))
+#define FIRST_SQUARE(squares) __builtin_ctzll(squares)
+
+// position of generated game
+typedef struct {
+    // FEN letter of piece on every square, '-' for empty one,
+    // square is (row << 3) | col as POSITION of pgn2pdf
+    char square[64];
+    // side to move, 0 - white, 1 - black
+    int black;
+    // castling rights left: 1 - K, 2 - Q, 4 - k, 8 - q
+    int castling;
+    // square passed by pawn moved two squares, -1 if none
+    int ep;
+} position_t;
+
+typedef struct {
+    unsigned char from;
+    unsigned char to;
+    // piece letter of promotion, 0 otherwise
+    char promotion;
+} gen_move_t;
+
+// growing string of generated text
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+    // length of the last line
+    int col;
+} text_t;
+
+static uint64_t seed = 1;
+static const char *eol = "\n";
+
+/*
+ * output: return next pseudo-random number (xorshift64*)
+ */
+static uint64_t
+next_random(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+static int
+random_below(int n)
+{
+    return next_random() % n;
+}
+
+static void
+text_add(text_t *text, const char *str, int len)
+{
+    if (text->len + len + 1 > text->size) {
+        text->size = (text->len + len + 1) * 2;
+        text->data = realloc(text->data, text->size);
+        if (NULL == text->data) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    memcpy(text->data + text->len, str, len);
+    text->len += len;
+    text->data[text->len] = '\0';
+}
+
+/*
+ * input: text - movetext being written
+ *        token - token to add, separated by space or line break
+ * output: text - token appended, lines kept under LINE_MAX
+ */
+static void
+text_token(text_t *text, const char *token)
+{
+    int len = strlen(token);
+
+    if (text->col > 0 && text->col + 1 + len > LINE_MAX) {
+        text_add(text, eol, strlen(eol));
+        text->col = 0;
+    } else if (text->col > 0) {
+        text_add(text, " ", 1);
+        ++text->col;
+    }
+    text_add(text, token, len);
+    text->col += len;
+}
+
+// row and column steps of pieces, rook steps go first among king ones
+static const int knight_steps[8][2] = {
+    { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 },
+    { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 }
+};
+static const int king_steps[8][2] = {
+    { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 },
+    { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 }
+};
+#define rook_steps king_steps
+#define bishop_steps (king_steps + 4)
+
+static int
+color_of(char piece)
+{
+    if ('-' == piece) return -1;
+    return islower(piece) ? 1 : 0;
+}
+
+// letter of piece for side, upper case for white
+static char
+side_piece(char piece, int black)
+{
+    return black ? tolower(piece) : toupper(piece);
+}
+
+/*
+ * input: pos - position
+ *        place - square to step from
+ *        steps, steps_nr - row and column steps
+ *        slide - go on stepping over empty squares?
+ * output: return squares reached, the piece stopping a slide included
+ */
+static squares_t
+reach(const position_t *pos, int place, const int (*steps)[2], int steps_nr,
+      int slide)
+{
+    squares_t squares = 0;
+    int row, col, i;
+
+    for (i = 0; i < steps_nr; ++i) {
+        row = (place >> 3) + steps[i][0];
+        col = (place & 7) + steps[i][1];
+        while (row >= 0 && row < 8 && col >= 0 && col < 8) {
+            squares |= SQUARE_BIT((row << 3) | col);
+            if (!slide || pos->square[(row << 3) | col] != '-') break;
+            row += steps[i][0];
+            col += steps[i][1];
+        }
+    }
+    return squares;
+}
+
+/*
+ * input: pos - position
+ *        squares - squares to look at
+ *        piece, piece2 - FEN letters of pieces
+ * output: return 1 if one of squares has piece or piece2 on it
+ */
+static int
+has_piece(const position_t *pos, squares_t squares, char piece, char piece2)
+{
+    for (; squares; squares &= squares - 1) {
+        char on = pos->square[FIRST_SQUARE(squares)];
+
+        if (on == piece || on == piece2)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * input: pos - position
+ *        place - square
+ *        by - attacking side
+ * output: return 1 if square is attacked by side, 0 otherwise
+ */
+static int
+attacked(const position_t *pos, int place, int by)
+{
+    char queen = side_piece('Q', by);
+    int row = (place >> 3) + (by ? 1 : -1);
+    int col = place & 7;
+
+    // pawns of side attack forward, from the row behind place
+    if (row >= 0 && row < 8) {
+        if (col > 0 && pos->square[(row << 3) | (col - 1)] == side_piece('P', by))
+            return 1;
+        if (col < 7 && pos->square[(row << 3) | (col + 1)] == side_piece('P', by))
+            return 1;
+    }
+    if (has_piece(pos, reach(pos, place, knight_steps, 8, 0), side_piece('N', by), 0))
+        return 1;
+    if (has_piece(pos, reach(pos, place, king_steps, 8, 0), side_piece('K', by), 0))
+        return 1;
+    if (has_piece(pos, reach(pos, place, rook_steps, 4, 1), side_piece('R', by), queen))
+        return 1;
+    if (has_piece(pos, reach(pos, place, bishop_steps, 4, 1), side_piece('B', by), queen))
+        return 1;
+    return 0;
+}
+
+static int
+king_place(const position_t *pos, int color)
+{
+    char king = side_piece('K', color);
+    int i;
+
+    for (i = 0; i < 64; ++i)
+        if (pos->square[i] == king)
+            return i;
+    return -1;
+}
+
+static int
+in_check(const position_t *pos)
+{
+    int king = king_place(pos, pos->black);
+
+    return king >= 0 && attacked(pos, king, !pos->black);
+}
+
+static void
+init_position(position_t *pos)
+{
+    const char *rows[8] = {
+        "RNBQKBNR", "PPPPPPPP", "--------", "--------",
+        "--------", "--------", "pppppppp", "rnbqkbnr"
+    };
+    int row;
+
+    for (row = 0; row < 8; ++row)
+        memcpy(pos->square + (row << 3), rows[row], 8);
+    pos->black = 0;
+    pos->castling = 0x0f;
+    pos->ep = -1;
+}
+
+/*
+ * input: pos - position
+ *        move - move of side to move
+ * output: return position after the move
+ */
+static position_t
+make_move(const position_t *pos, const gen_move_t *move)
+{
+    position_t next = *pos;
+    char piece = pos->square[move->from];
+    int dir = pos->black ? -8 : 8;
+    int i;
+
+    // en passant takes pawn beside the square moved to
+    if (toupper(piece) == 'P' && move->to == pos->ep)
+        next.square[move->to - dir] = '-';
+
+    // castling moves rook over the king
+    if (toupper(piece) == 'K' && abs(move->to - move->from) == 2) {
+        int rook_from = move->to > move->from ? move->from + 3 : move->from - 4;
+        int rook_to = (move->from + move->to) / 2;
+
+        next.square[rook_to] = next.square[rook_from];
+        next.square[rook_from] = '-';
+    }
+
+    next.square[move->to] = move->promotion ?
+                            side_piece(move->promotion, pos->black) : piece;
+    next.square[move->from] = '-';
+
+    // rights are lost by king or rook move and by rook capture
+    for (i = 0; i < 2; ++i) {
+        int place = i ? move->to : move->from;
+
+        if (place == 0 || place == 4) next.castling &= ~2;
+        if (place == 7 || place == 4) next.castling &= ~1;
+        if (place == 56 || place == 60) next.castling &= ~8;
+        if (place == 63 || place == 60) next.castling &= ~4;
+    }
+
+    next.ep = -1;
+    if (toupper(piece) == 'P' && abs(move->to - move->from) == 16)
+        next.ep = move->from + dir;
+
+    next.black = !pos->black;
+    return next;
+}
+
+static int
+add_move(gen_move_t *moves, int nr, int from, int to, char promotion)
+{
+    moves[nr].from = from;
+    moves[nr].to = to;
+    moves[nr].promotion = promotion;
+    return nr + 1;
+}
+
+/*
+ * input: pos - position
+ *        moves - where to store moves, MAX_MOVES of them
+ * output: return number of legal moves of side to move
+ */
+static int
+legal_moves(const position_t *pos, gen_move_t *moves)
+{
+    gen_move_t pseudo[MAX_MOVES];
+    squares_t targets;
+    int dir = pos->black ? -8 : 8;
+    int start_row = pos->black ? 6 : 1;
+    int last_row = pos->black ? 0 : 7;
+    int back = pos->black ? 56 : 0;
+    int nr = 0, legal = 0;
+    int from, to, i;
+    position_t next;
+
+    for (from = 0; from < 64; ++from) {
+        char piece = pos->square[from];
+
+        if (color_of(piece) != pos->black) continue;
+
+        switch (toupper(piece)) {
+            case 'P':
+                // captures, en passant one too
+                targets = 0;
+                to = from + dir;
+                for (i = -1; i <= 1; i += 2) {
+                    if ((from & 7) + i < 0 || (from & 7) + i > 7) continue;
+                    if (color_of(pos->square[to + i]) == !pos->black ||
+                        to + i == pos->ep)
+                        targets |= SQUARE_BIT(to + i);
+                }
+                if (pos->square[to] == '-') {
+                    targets |= SQUARE_BIT(to);
+                    if ((from >> 3) == start_row && pos->square[to + dir] == '-')
+                        targets |= SQUARE_BIT(to + dir);
+                }
+                for (; targets; targets &= targets - 1) {
+                    to = FIRST_SQUARE(targets);
+                    if ((to >> 3) == last_row) {
+                        for (i = 0; i < 4; ++i)
+                            nr = add_move(pseudo, nr, from, to, "QRBN"[i]);
+                    } else {
+                        nr = add_move(pseudo, nr, from, to, 0);
+                    }
+                }
+                continue;
+            case 'N':
+                targets = reach(pos, from, knight_steps, 8, 0);
+                break;
+            case 'B':
+                targets = reach(pos, from, bishop_steps, 4, 1);
+                break;
+            case 'R':
+                targets = reach(pos, from, rook_steps, 4, 1);
+                break;
+            case 'Q':
+                targets = reach(pos, from, king_steps, 8, 1);
+                break;
+            default:
+                targets = reach(pos, from, king_steps, 8, 0);
+                break;
+        }
+
+        for (; targets; targets &= targets - 1) {
+            to = FIRST_SQUARE(targets);
+            if (color_of(pos->square[to]) != pos->black)
+                nr = add_move(pseudo, nr, from, to, 0);
+        }
+    }
+
+    // castling, king and rook are where rights say they are
+    if (!in_check(pos)) {
+        if ((pos->castling & (pos->black ? 4 : 1)) &&
+            pos->square[back + 5] == '-' && pos->square[back + 6] == '-' &&
+            !attacked(pos, back + 5, !pos->black) &&
+            !attacked(pos, back + 6, !pos->black))
+            nr = add_move(pseudo, nr, back + 4, back + 6, 0);
+        if ((pos->castling & (pos->black ? 8 : 2)) &&
+            pos->square[back + 1] == '-' && pos->square[back + 2] == '-' &&
+            pos->square[back + 3] == '-' &&
+            !attacked(pos, back + 3, !pos->black) &&
+            !attacked(pos, back + 2, !pos->black))
+            nr = add_move(pseudo, nr, back + 4, back + 2, 0);
+    }
+
+    for (i = 0; i < nr; ++i) {
+        next = make_move(pos, &pseudo[i]);
+        if (!attacked(&next, king_place(&next, pos->black), next.black))
+            moves[legal++] = pseudo[i];
+    }
+    return legal;
+}
+
+/*
+ * input: pos - position
+ *        move - legal move of side to move
+ *        moves, nr - all legal moves of position
+ *        to - where to store SAN
+ * output: to - SAN of move with check/mate mark
+ */
+static void
+move_san(const position_t *pos, const gen_move_t *move,
+         const gen_move_t *moves, int nr, char *to)
+{
+    gen_move_t replies[MAX_MOVES];
+    char piece = toupper(pos->square[move->from]);
+    int capture = pos->square[move->to] != '-' ||
+                  ('P' == piece && move->to == pos->ep);
+    int same_file = 0, same_rank = 0, ambiguous = 0;
+    position_t next;
+    int i;
+
+    if ('K' == piece && abs(move->to - move->from) == 2) {
+        to = stpcpy(to, move->to > move->from ? "O-O" : "O-O-O");
+    } else if ('P' == piece) {
+        if (capture) {
+            *to++ = 'a' + (move->from & 7);
+            *to++ = 'x';
+        }
+        *to++ = 'a' + (move->to & 7);
+        *to++ = '1' + (move->to >> 3);
+        if (move->promotion) {
+            *to++ = '=';
+            *to++ = move->promotion;
+        }
+    } else {
+        *to++ = piece;
+        for (i = 0; i < nr; ++i) {
+            if (moves[i].to != move->to || moves[i].from == move->from ||
+                toupper(pos->square[moves[i].from]) != piece)
+                continue;
+            ambiguous = 1;
+            if ((moves[i].from & 7) == (move->from & 7)) same_file = 1;
+            if ((moves[i].from >> 3) == (move->from >> 3)) same_rank = 1;
+        }
+        if (ambiguous && (!same_file || same_rank))
+            *to++ = 'a' + (move->from & 7);
+        if (ambiguous && same_file)
+            *to++ = '1' + (move->from >> 3);
+        if (capture)
+            *to++ = 'x';
+        *to++ = 'a' + (move->to & 7);
+        *to++ = '1' + (move->to >> 3);
+    }
+
+    next = make_move(pos, move);
+    if (in_check(&next))
+        *to++ = legal_moves(&next, replies) ? '+' : '#';
+    *to = '\0';
+}
+
+/*
+ * input: pos - position
+ * output: return FNV-1a hash of square letters, as bench computes it
+ *         from board of pgn2pdf
+ */
+static uint32_t
+checksum(const position_t *pos)
+{
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < 64; ++i)
+        hash = (hash ^ (unsigned char)pos->square[i]) * 16777619u;
+    return hash;
+}
+
+static const char *comments[] = {
+    "a strong move", "the only move", "better was to wait",
+    "white is better", "black has compensation", "unclear"
+};
+static const char *glyphs[] = { "!", "?", "!!", "??", "!?", "?!" };
+
+/*
+ * input: moves_nr - most plies of the game
+ *        notes - percent of plies with comment, NAG or variation
+ *        k - game number
+ *        out - pgn-file
+ *        golden - file of per-ply checksums
+ * output: game written to out, "<plies> <checksum>..." line to golden
+ */
+static void
+write_game(int moves_nr, int notes, int k, FILE *out, FILE *golden)
+{
+    static text_t text;
+    static uint32_t *checksums;
+    static int checksums_size;
+    gen_move_t moves[MAX_MOVES];
+    position_t pos;
+    char san[32];
+    char token[64];
+    const char *result;
+    int plies = moves_nr / 2 + random_below(moves_nr / 2 + 1);
+    int ply, nr = 0, choice, note, i;
+    int number_needed = 1;
+    int year, month, day, white, black;
+
+    if (checksums_size < plies) {
+        checksums_size = plies;
+        checksums = realloc(checksums, sizeof(uint32_t) * plies);
+        if (NULL == checksums) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    text.len = 0;
+    text.col = 0;
+    init_position(&pos);
+
+    for (ply = 0; ply < plies; ++ply) {
+        nr = legal_moves(&pos, moves);
+        if (0 == nr) break;
+        choice = random_below(nr);
+
+        if (!pos.black) {
+            sprintf(token, "%d.", ply / 2 + 1);
+            text_token(&text, token);
+        } else if (number_needed) {
+            sprintf(token, "%d...", ply / 2 + 1);
+            text_token(&text, token);
+        }
+        number_needed = 0;
+
+        move_san(&pos, &moves[choice], moves, nr, san);
+        note = random_below(100) < notes ? random_below(5) : -1;
+        if (1 == note)
+            strcat(san, glyphs[random_below(6)]);
+        text_token(&text, san);
+
+        switch (note) {
+            case 0:
+                sprintf(token, "{%s}", comments[random_below(6)]);
+                text_token(&text, token);
+                number_needed = 1;
+                break;
+            case 2:
+                sprintf(token, "$%d", 1 + random_below(20));
+                text_token(&text, token);
+                break;
+            case 3:
+                if (nr < 2) break;
+                // another move of the same position
+                move_san(&pos, &moves[(choice + 1 + random_below(nr - 1)) % nr],
+                         moves, nr, san);
+                sprintf(token, "(%d%s", ply / 2 + 1, pos.black ? "..." : ".");
+                text_token(&text, token);
+                sprintf(token, "%s)", san);
+                text_token(&text, token);
+                number_needed = 1;
+                break;
+            case 4:
+                sprintf(token, ";%s", comments[random_below(6)]);
+                text_token(&text, token);
+                text_add(&text, eol, strlen(eol));
+                text.col = 0;
+                number_needed = 1;
+                break;
+        }
+
+        pos = make_move(&pos, &moves[choice]);
+        checksums[ply] = checksum(&pos);
+    }
+
+    // plies made, mate or stalemate ends game earlier
+    fprintf(golden, "%d", ply);
+    for (i = 0; i < ply; ++i)
+        fprintf(golden, " %08x", checksums[i]);
+    fputc('\n', golden);
+
+    if (ply == plies && legal_moves(&pos, moves) > 0) {
+        const char *results[] = { "1-0", "0-1", "1/2-1/2", "*" };
+        result = results[random_below(4)];
+    } else if (in_check(&pos)) {
+        result = pos.black ? "1-0" : "0-1";
+    } else {
+        result = "1/2-1/2";
+    }
+    text_token(&text, result);
+
+    // drawn one by one, order of arguments is not defined
+    year = 1900 + random_below(120);
+    month = 1 + random_below(12);
+    day = 1 + random_below(28);
+    white = random_below(1000);
+    black = random_below(1000);
+
+    fprintf(out, "[Event \"Bench %d\"]%s", k / 100, eol);
+    fprintf(out, "[Site \"Nowhere\"]%s", eol);
+    fprintf(out, "[Date \"%d.%02d.%02d\"]%s", year, month, day, eol);
+    fprintf(out, "[Round \"%d\"]%s", 1 + k % 100, eol);
+    fprintf(out, "[White \"Player %d\"]%s", white, eol);
+    fprintf(out, "[Black \"Player %d\"]%s", black, eol);
+    fprintf(out, "[Result \"%s\"]%s%s", result, eol, eol);
+    fwrite(text.data, 1, text.len, out);
+    fprintf(out, "%s%s", eol, eol);
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *out, *golden;
+    int games = 1000;
+    int plies = 80;
+    int notes = 0;
+    int opt;
+    int k;
+
+    while ((opt = getopt(argc, argv, "n:p:a:s:c")) != -1) {
+        switch (opt) {
+            case 'n':
+                games = atoi(optarg);
+                break;
+            case 'p':
+                plies = atoi(optarg);
+                break;
+            case 'a':
+                notes = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'c':
+                eol = "\r\n";
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+
+    if (argc - optind != 2 || plies < 1) {
+        printf("usage: %s [-n games] [-p plies] [-a notes] [-s seed] [-c] <out.pgn> <out.golden>\n"
+               "  random legal games of plies/2 to plies plies (mate ends them earlier)\n"
+               "  -a notes - percent of plies with comment, NAG or variation\n"
+               "  -s seed - the same seed gives the same games\n"
+               "  -c - CRLF line ends\n"
+               "  <out.golden> - line of per-ply board checksums for every game\n",
+               argv[0]);
+        return 1;
+    }
+
+    // xorshift never leaves 0
+    if (0 == seed) seed = 1;
+
+    out = fopen(argv[optind], "wb");
+    golden = fopen(argv[optind + 1], "w");
+    if (!out || !golden) {
+        perror("cant open output");
+        return 1;
+    }
+
+    for (k = 0; k < games; ++k)
+        write_game(plies, notes, k, out, golden);
+
+    fclose(out);
+    fclose(golden);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboard.h"
+
+bitboard_t bb_knight_attacks[64];
+bitboard_t bb_king_attacks[64];
+bitboard_t bb_pawn_attacks[2][64];
+bitboard_t bb_line[64][64];
+bitboard_t bb_between[64][64];
+
+bb_slider_t bb_rook_sliders[64];
+bb_slider_t bb_bishop_sliders[64];
+
+/*
+ * magic multipliers: (occupancy & mask) * magic >> shift gives
+ * a distinct table index for every occupancy with distinct attacks,
+ * found once by random search with shift = 64 - popcount(mask)
+ */
+static const bitboard_t rook_magics[64] = {
+    0x1080004008801020ULL, 0x0840092002c03000ULL,
+    0x1900200010400900ULL, 0x0880100008000480ULL,
+    0x4200100420080200ULL, 0x8100020100080400ULL,
+    0x0200040110886200ULL, 0x0200008040220411ULL,
+    0x0404800084400220ULL, 0x0000401000402000ULL,
+    0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000a001201040820ULL, 0x8848800200840080ULL,
+    0x4001000100040200ULL, 0x0442000102105084ULL,
+    0x9080010020804100ULL, 0x0040404000201009ULL,
+    0x0000808010002009ULL, 0x2200090021d00100ULL,
+    0x0008008008040080ULL, 0x0004004002010040ULL,
+    0x0011040008015042ULL, 0x00000a0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL,
+    0x9800200280100080ULL, 0x1000100080080080ULL,
+    0x0442000a00049020ULL, 0x2100040080020080ULL,
+    0x0800120400900148ULL, 0x0010040a00128541ULL,
+    0x2800804000800030ULL, 0x1010002000400041ULL,
+    0x4000200011004100ULL, 0x0610008410800800ULL,
+    0x0400802402800800ULL, 0xc100020080800400ULL,
+    0x0002000802000401ULL, 0x0182085882000401ULL,
+    0x0220204000808000ULL, 0x2860100040024022ULL,
+    0x0001002004110040ULL, 0x99101042000a0020ULL,
+    0x0004080004008080ULL, 0x0010040002008080ULL,
+    0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL,
+    0x0110910040a00300ULL, 0x0801100280080480ULL,
+    0x0242009008200600ULL, 0x1002000489500200ULL,
+    0x0040800200010080ULL, 0x0091800041000080ULL,
+    0x0000209300488001ULL, 0x04c1002414824001ULL,
+    0x020020000b001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084c0007ULL,
+    0x0888221800813004ULL, 0x4000002840840112ULL
+};
+
+static const bitboard_t bishop_magics[64] = {
+    0xa010041108003100ULL, 0x006082020a002900ULL,
+    0x6810010619200000ULL, 0x08281a0520000408ULL,
+    0x0001104001000400ULL, 0x0018901008048400ULL,
+    0x00040a0210245280ULL, 0x000200210808a402ULL,
+    0x9140048410821200ULL, 0x0800091010820041ULL,
+    0x20504804832202c0ULL, 0x0100091401081000ULL,
+    0x8021011140000012ULL, 0x0810020804450400ULL,
+    0x208b0542109008a2ULL, 0x0080084a08040204ULL,
+    0x0040e2a80811244cULL, 0x2505022008008108ULL,
+    0x0430220100420040ULL, 0x010a040420220040ULL,
+    0x1105000290400000ULL, 0x0093001200822120ULL,
+    0x4000a62048043004ULL, 0x280120048a015004ULL,
+    0x006090002a020814ULL, 0x44042000240800d0ULL,
+    0x01102800040a4400ULL, 0x1004080080220040ULL,
+    0x0001001011004024ULL, 0x0010044000805040ULL,
+    0x0914041200820100ULL, 0x0004821012821480ULL,
+    0x0024040500c05021ULL, 0x0088611002080200ULL,
+    0x0116080a00040020ULL, 0x4000020080080080ULL,
+    0x2450450140840040ULL, 0x0000880201484100ULL,
+    0x0222020404020092ULL, 0x8081110600002e00ULL,
+    0x2842101105000801ULL, 0x1100809008001025ULL,
+    0x00020202221c0400ULL, 0x0422014022009020ULL,
+    0x0210046102100c00ULL, 0xc004008082029102ULL,
+    0x00aa461801101200ULL, 0x0404080080201108ULL,
+    0x020542108c205002ULL, 0x0410544804100100ULL,
+    0x0040910841100000ULL, 0x0400200042021100ULL,
+    0x00004204850400c0ULL, 0x0200100410a42102ULL,
+    0x1040020801210102ULL, 0x0805040410420000ULL,
+    0x2884804130100200ULL, 0x800c262201242000ULL,
+    0x1058000194108800ULL, 0x0014221054420204ULL,
+    0x0104000012a02200ULL, 0x0200881003300100ULL,
+    0x0140400202840100ULL, 0x0402020801010201ULL
+};
+
+// 4096 occupancies for every rook square at most, 512 for bishop
+static bitboard_t rook_table[102400];
+static bitboard_t bishop_table[5248];
+
+static const int rook_dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+static const int bishop_dirs[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+/*
+ * input: pos - square of slider
+ *        occupied - occupancy
+ *        dirs - directions (row, col) of slider
+ *        edges - 1 - stop before board edge (relevant occupancy mask)
+ * output: return attacked squares, walking ray by ray
+ */
+static bitboard_t
+slow_attacks(int pos, bitboard_t occupied, const int dirs[4][2], int edges)
+{
+    bitboard_t attacks = 0;
+    int d, row, col;
+
+    for (d = 0; d < 4; ++d) {
+        row = (pos >> 3) + dirs[d][0];
+        col = (pos & 0x07) + dirs[d][1];
+        while (row >= 0 && row < 8 && col >= 0 && col < 8) {
+            if (edges &&
+                (row + dirs[d][0] < 0 || row + dirs[d][0] > 7 ||
+                 col + dirs[d][1] < 0 || col + dirs[d][1] > 7))
+                break;
+
+            attacks |= BB_SQUARE((row << 3) | col);
+            if (occupied & BB_SQUARE((row << 3) | col))
+                break;
+
+            row += dirs[d][0];
+            col += dirs[d][1];
+        }
+    }
+
+    return attacks;
+}
+
+/*
+ * input: sliders - sliders of all squares to fill
+ *        magics - magic multipliers
+ *        dirs - directions of slider
+ *        table - space for attacks of all squares
+ * output: sliders - masks and attacks for every relevant occupancy
+ */
+static void
+init_sliders(bb_slider_t *sliders, const bitboard_t *magics,
+             const int dirs[4][2], bitboard_t *table)
+{
+    bitboard_t occupied;
+    bb_slider_t *slider;
+    unsigned long idx;
+    int pos;
+
+    for (pos = 0; pos < 64; ++pos) {
+        slider = &sliders[pos];
+        slider->mask = slow_attacks(pos, 0, dirs, 1);
+        slider->magic = magics[pos];
+        slider->shift = 64 - BB_COUNT(slider->mask);
+        slider->attacks = table;
+
+        // every subset of mask
+        occupied = 0;
+        do {
+#ifdef __BMI2__
+            idx = _pext_u64(occupied, slider->mask);
+#else
+            idx = (occupied * slider->magic) >> slider->shift;
+#endif
+            slider->attacks[idx] = slow_attacks(pos, occupied, dirs, 0);
+            occupied = (occupied - slider->mask) & slider->mask;
+        } while (occupied);
+
+        table += 1UL << BB_COUNT(slider->mask);
+    }
+}
+
+/*
+ * input: pos - square
+ *        steps - (row, col) steps of the piece
+ *        steps_nr - number of steps
+ * output: return squares reached by one step
+ */
+static bitboard_t
+step_attacks(int pos, const int steps[][2], int steps_nr)
+{
+    bitboard_t attacks = 0;
+    int i, row, col;
+
+    for (i = 0; i < steps_nr; ++i) {
+        row = (pos >> 3) + steps[i][0];
+        col = (pos & 0x07) + steps[i][1];
+        if (row >= 0 && row < 8 && col >= 0 && col < 8)
+            attacks |= BB_SQUARE((row << 3) | col);
+    }
+
+    return attacks;
+}
+
+/*
+ * output: bb_line and bb_between filled, sliders should be ready
+ */
+static void
+init_lines(void)
+{
+    bitboard_t from_bb, to_bb;
+    int from, to;
+
+    for (from = 0; from < 64; ++from) {
+        for (to = 0; to < 64; ++to) {
+            if (from == to) continue;
+            from_bb = BB_SQUARE(from);
+            to_bb = BB_SQUARE(to);
+
+            if (bb_rook_attacks(from, 0) & to_bb) {
+                bb_line[from][to] = (bb_rook_attacks(from, 0) &
+                                     bb_rook_attacks(to, 0)) | from_bb | to_bb;
+                bb_between[from][to] = bb_rook_attacks(from, to_bb) &
+                                       bb_rook_attacks(to, from_bb);
+            } else if (bb_bishop_attacks(from, 0) & to_bb) {
+                bb_line[from][to] = (bb_bishop_attacks(from, 0) &
+                                     bb_bishop_attacks(to, 0)) | from_bb | to_bb;
+                bb_between[from][to] = bb_bishop_attacks(from, to_bb) &
+                                       bb_bishop_attacks(to, from_bb);
+            }
+        }
+    }
+}
+
+/*
+ * output: attack tables filled, call once before any lookup
+ */
+void
+bb_init(void)
+{
+    static const int knight_steps[8][2] = {
+        {1, 2}, {2, 1}, {2, -1}, {1, -2},
+        {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}
+    };
+    static const int king_steps[8][2] = {
+        {1, -1}, {1, 0}, {1, 1}, {0, -1},
+        {0, 1}, {-1, -1}, {-1, 0}, {-1, 1}
+    };
+    static const int white_pawn_steps[2][2] = {{1, -1}, {1, 1}};
+    static const int black_pawn_steps[2][2] = {{-1, -1}, {-1, 1}};
+    int pos;
+
+    for (pos = 0; pos < 64; ++pos) {
+        bb_knight_attacks[pos] = step_attacks(pos, knight_steps, 8);
+        bb_king_attacks[pos] = step_attacks(pos, king_steps, 8);
+        bb_pawn_attacks[0][pos] = step_attacks(pos, white_pawn_steps, 2);
+        bb_pawn_attacks[1][pos] = step_attacks(pos, black_pawn_steps, 2);
+    }
+
+    init_sliders(bb_rook_sliders, rook_magics, rook_dirs, rook_table);
+    init_sliders(bb_bishop_sliders, bishop_magics, bishop_dirs, bishop_table);
+    init_lines();
+}
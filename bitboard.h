@@ -0,0 +1,68 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// one bit per square, bit number is POSITION(row, col)
+typedef uint64_t bitboard_t;
+
+#define BB_SQUARE(pos) ((bitboard_t)1 << (pos))
+#define BB_FILE(col) (0x0101010101010101ULL << (col))
+#define BB_RANK(row) (0xffULL << ((row) << 3))
+
+// index of the lowest set bit, bb should not be empty
+#define BB_FIRST(bb) __builtin_ctzll(bb)
+#define BB_COUNT(bb) __builtin_popcountll(bb)
+
+// sliding attacks of a square, looked up by occupancy
+typedef struct {
+    // occupancy squares that matter (board edges excluded)
+    bitboard_t mask;
+    bitboard_t magic;
+    // attacks for every relevant occupancy
+    bitboard_t *attacks;
+    unsigned char shift;
+} bb_slider_t;
+
+extern bitboard_t bb_knight_attacks[64];
+extern bitboard_t bb_king_attacks[64];
+// squares attacked by pawn of color standing on square
+extern bitboard_t bb_pawn_attacks[2][64];
+// whole line through both squares, 0 if they are not on one line
+extern bitboard_t bb_line[64][64];
+// squares strictly between both squares on one line, 0 otherwise
+extern bitboard_t bb_between[64][64];
+
+extern bb_slider_t bb_rook_sliders[64];
+extern bb_slider_t bb_bishop_sliders[64];
+
+void
+bb_init(void);
+
+static inline bitboard_t
+bb_slider_attacks(const bb_slider_t *slider, bitboard_t occupied)
+{
+#ifdef __BMI2__
+    return slider->attacks[_pext_u64(occupied, slider->mask)];
+#else
+    return slider->attacks[((occupied & slider->mask) * slider->magic) >> slider->shift];
+#endif
+}
+
+static inline bitboard_t
+bb_rook_attacks(int pos, bitboard_t occupied)
+{
+    return bb_slider_attacks(&bb_rook_sliders[pos], occupied);
+}
+
+static inline bitboard_t
+bb_bishop_attacks(int pos, bitboard_t occupied)
+{
+    return bb_slider_attacks(&bb_bishop_sliders[pos], occupied);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "emitter.h"
+
+// first buffer size of emitter collecting in memory
+#define EMITTER_MEMORY (64 << 10)
+
+/*
+ * input: emitter - emitter to set up
+ *        fd - file to write to, -1 to collect output in memory
+ */
+void
+emitter_init(emitter_t *emitter, int fd)
+{
+    emitter->buf = NULL;
+    emitter->len = 0;
+    emitter->size = 0;
+    emitter->flushed = 0;
+    emitter->fd = fd;
+    emitter->error = 0;
+    emitter->allocs = 0;
+}
+
+/*
+ * input: emitter - emitter
+ * output: return 0 - ok, -1 - write failed (now or before)
+ *         buffered bytes written to fd, kept if collecting in memory
+ */
+int
+emitter_flush(emitter_t *emitter)
+{
+    size_t done = 0;
+    ssize_t got;
+
+    if (emitter->fd < 0) return emitter->error ? -1 : 0;
+
+    while (done < emitter->len && !emitter->error) {
+        got = write(emitter->fd, emitter->buf + done, emitter->len - done);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            emitter->error = errno;
+            break;
+        }
+        done += got;
+    }
+
+    emitter->flushed += emitter->len;
+    emitter->len = 0;
+    return emitter->error ? -1 : 0;
+}
+
+/*
+ * input: emitter - emitter without len bytes free
+ *        len - bytes to be appended
+ * output: return where to put len bytes, NULL on failure
+ */
+char *
+emitter_reserve_slow(emitter_t *emitter, size_t len)
+{
+    size_t size = emitter->size;
+    char *bigger;
+    char *to;
+
+    if (emitter->fd >= 0 && emitter->len) {
+        if (emitter_flush(emitter) < 0) return NULL;
+        if (emitter->size - emitter->len >= len)
+            return emitter_reserve(emitter, len);
+    }
+
+    if (0 == size)
+        size = emitter->fd >= 0 ? EMITTER_BUFFER : EMITTER_MEMORY;
+    while (size - emitter->len < len)
+        size *= 2;
+
+    bigger = realloc(emitter->buf, size);
+    if (NULL == bigger) {
+        emitter->error = ENOMEM;
+        return NULL;
+    }
+    emitter->buf = bigger;
+    emitter->size = size;
+    ++emitter->allocs;
+
+    to = emitter->buf + emitter->len;
+    emitter->len += len;
+    return to;
+}
+
+void
+emitter_free(emitter_t *emitter)
+{
+    free(emitter->buf);
+    emitter->buf = NULL;
+    emitter->len = emitter->size = 0;
+}
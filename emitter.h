@@ -0,0 +1,95 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <stddef.h>
+#include <string.h>
+
+// buffer size of emitter writing to file
+#ifndef EMITTER_BUFFER
+#define EMITTER_BUFFER (1 << 20)
+#endif
+
+// append buffer for output, flushed to fd with large write() calls
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+    // bytes written to fd before buf
+    size_t flushed;
+    // where to flush, -1 to only collect in memory (buffer grows then)
+    int fd;
+    // has write() or allocation failed? (errno is kept in it)
+    int error;
+    // buffer allocations since emitter_init, for stats
+    unsigned long allocs;
+} emitter_t;
+
+void
+emitter_init(emitter_t *emitter, int fd);
+
+char *
+emitter_reserve_slow(emitter_t *emitter, size_t len);
+
+int
+emitter_flush(emitter_t *emitter);
+
+void
+emitter_free(emitter_t *emitter);
+
+/*
+ * input: emitter - emitter
+ *        len - bytes to be appended
+ * output: return where to put len bytes, NULL on failure
+ *         the bytes are taken as appended
+ */
+static inline char *
+emitter_reserve(emitter_t *emitter, size_t len)
+{
+    char *to;
+
+    if (emitter->size - emitter->len < len)
+        return emitter_reserve_slow(emitter, len);
+
+    to = emitter->buf + emitter->len;
+    emitter->len += len;
+    return to;
+}
+
+// offset of the next byte appended from the start of output
+static inline size_t
+emitter_tell(const emitter_t *emitter)
+{
+    return emitter->flushed + emitter->len;
+}
+
+static inline void
+emitter_bytes(emitter_t *emitter, const void *bytes, size_t len)
+{
+    char *to = emitter_reserve(emitter, len);
+
+    if (to) memcpy(to, bytes, len);
+}
+
+static inline void
+emitter_str(emitter_t *emitter, const char *str)
+{
+    emitter_bytes(emitter, str, strlen(str));
+}
+
+static inline void
+emitter_int(emitter_t *emitter, int value)
+{
+    char digits[12];
+    int i = sizeof(digits);
+    unsigned int u = value < 0 ? -(unsigned int)value : value;
+
+    do {
+        digits[--i] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (value < 0) digits[--i] = '-';
+
+    emitter_bytes(emitter, digits + i, sizeof(digits) - i);
+}
+
+#endif
@@ -0,0 +1,552 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <linux/limits.h>
+#include <zlib.h>
+
+#include "pdf_writer.h"
+
+static const unsigned char PngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+// widths of Helvetica glyphs 32..126 in 1/1000 of font size
+static const unsigned short helvetica_widths[95] = {
+    278, 278, 355, 556, 556, 889, 667, 191, 333, 333, 389, 584, 278, 333, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 556, 556, 556, 278, 278, 584, 584, 584, 556,
+    1015, 667, 667, 722, 722, 667, 611, 778, 722, 278, 500, 667, 556, 833, 722, 778,
+    667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611, 278, 278, 278, 469, 556,
+    333, 556, 556, 500, 556, 556, 278, 556, 556, 222, 222, 500, 222, 833, 556, 556,
+    556, 556, 333, 500, 278, 556, 500, 722, 500, 500, 500, 334, 260, 334, 584
+};
+
+// decoded png image
+typedef struct {
+    int width;
+    int height;
+    // width * height * 3 bytes
+    unsigned char *rgb;
+    // width * height bytes, NULL if image is opaque
+    unsigned char *alpha;
+} pdf_image_t;
+
+static inline uint32_t
+read_be32(const unsigned char *in)
+{
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) |
+           ((uint32_t)in[2] << 8) | in[3];
+}
+
+static inline unsigned char
+paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+/*
+ * input: pixels - filtered scanlines, each starting with filter type
+ *        width, height - size of image
+ *        bpp - bytes per pixel
+ * output: return 0 - ok, -1 - unknown filter
+ *         pixels - scanlines unfiltered in place (filter bytes kept)
+ */
+static int
+png_unfilter(unsigned char *pixels, int width, int height, int bpp)
+{
+    size_t stride = (size_t)width * bpp;
+    unsigned char *row, *prev;
+    size_t i;
+    int y;
+
+    for (y = 0; y < height; ++y) {
+        row = pixels + y * (stride + 1) + 1;
+        prev = y ? row - (stride + 1) : NULL;
+
+        switch (row[-1]) {
+            case 0 :
+                break;
+            case 1 :
+                for (i = bpp; i < stride; ++i)
+                    row[i] += row[i - bpp];
+                break;
+            case 2 :
+                if (prev)
+                    for (i = 0; i < stride; ++i)
+                        row[i] += prev[i];
+                break;
+            case 3 :
+                for (i = 0; i < stride; ++i)
+                    row[i] += ((i >= bpp ? row[i - bpp] : 0) + (prev ? prev[i] : 0)) / 2;
+                break;
+            case 4 :
+                for (i = 0; i < stride; ++i)
+                    row[i] += paeth(i >= bpp ? row[i - bpp] : 0,
+                                    prev ? prev[i] : 0,
+                                    i >= bpp && prev ? prev[i - bpp] : 0);
+                break;
+            default :
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * input: image - image to fill
+ *        path - 8-bit RGB or RGBA non-interlaced png-file
+ * output: return 0 - ok, -1 - fail (reported)
+ *         image - decoded pixels
+ */
+static int
+png_load(pdf_image_t *image, const char *path)
+{
+    FILE *in;
+    unsigned char *file = NULL, *idat = NULL, *pixels = NULL;
+    unsigned char *chunk;
+    long file_len;
+    size_t idat_len = 0, pos;
+    uLongf pixels_len;
+    uint32_t chunk_len;
+    int bpp = 0;
+    int x, y;
+    unsigned char *row;
+    const char *error = "unsupported png";
+
+    memset(image, 0, sizeof(*image));
+
+    in = fopen(path, "rb");
+    if (NULL == in) {
+        fprintf(stderr, "cant open image '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    fseek(in, 0, SEEK_END);
+    file_len = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    file = malloc(file_len > 0 ? file_len : 1);
+    idat = malloc(file_len > 0 ? file_len : 1);
+    if (NULL == file || NULL == idat || fread(file, 1, file_len, in) != file_len) {
+        error = "cant read";
+        goto fail;
+    }
+
+    if (file_len < 8 || memcmp(file, PngSignature, 8)) goto fail;
+
+    for (pos = 8; pos + 12 <= file_len; pos += 12 + chunk_len) {
+        chunk_len = read_be32(file + pos);
+        chunk = file + pos + 8;
+        if (chunk_len > file_len - pos - 12) goto fail;
+
+        if (!memcmp(file + pos + 4, "IHDR", 4) && chunk_len >= 13) {
+            image->width = read_be32(chunk);
+            image->height = read_be32(chunk + 4);
+            // 8 bits per channel, no interlace
+            if (chunk[8] != 8 || chunk[12] != 0) goto fail;
+            if (chunk[9] == 6) bpp = 4;
+            else if (chunk[9] == 2) bpp = 3;
+            else goto fail;
+        } else if (!memcmp(file + pos + 4, "IDAT", 4)) {
+            memcpy(idat + idat_len, chunk, chunk_len);
+            idat_len += chunk_len;
+        } else if (!memcmp(file + pos + 4, "IEND", 4)) {
+            break;
+        }
+    }
+    if (0 == bpp || image->width <= 0 || image->height <= 0) goto fail;
+
+    pixels_len = (uLongf)image->height * (image->width * bpp + 1);
+    pixels = malloc(pixels_len);
+    image->rgb = malloc((size_t)image->width * image->height * 3);
+    if (bpp == 4)
+        image->alpha = malloc((size_t)image->width * image->height);
+    if (NULL == pixels || NULL == image->rgb || (bpp == 4 && NULL == image->alpha)) {
+        error = "out of memory for";
+        goto fail;
+    }
+
+    if (uncompress(pixels, &pixels_len, idat, idat_len) != Z_OK ||
+        pixels_len != (uLongf)image->height * (image->width * bpp + 1) ||
+        png_unfilter(pixels, image->width, image->height, bpp) < 0) {
+        error = "corrupted";
+        goto fail;
+    }
+
+    for (y = 0; y < image->height; ++y) {
+        row = pixels + y * ((size_t)image->width * bpp + 1) + 1;
+        for (x = 0; x < image->width; ++x) {
+            memcpy(image->rgb + ((size_t)y * image->width + x) * 3, row + x * bpp, 3);
+            if (bpp == 4)
+                image->alpha[(size_t)y * image->width + x] = row[x * bpp + 3];
+        }
+    }
+
+    free(pixels);
+    free(idat);
+    free(file);
+    fclose(in);
+    return 0;
+
+fail:
+    fprintf(stderr, "%s image '%s'\n", error, path);
+    free(pixels);
+    free(idat);
+    free(file);
+    free(image->rgb);
+    free(image->alpha);
+    fclose(in);
+    return -1;
+}
+
+/*
+ * input: pdf - writer
+ * output: return number of new object, its offset is not known yet
+ *         -1 if out of memory
+ */
+static int
+new_object(pdf_writer_t *pdf)
+{
+    size_t *bigger;
+
+    if (pdf->objects_nr == pdf->objects_size) {
+        bigger = realloc(pdf->objects, sizeof(size_t) * (pdf->objects_size * 2 + 64));
+        if (NULL == bigger) return -1;
+        pdf->objects = bigger;
+        pdf->objects_size = pdf->objects_size * 2 + 64;
+    }
+
+    pdf->objects[pdf->objects_nr] = 0;
+    return pdf->objects_nr++;
+}
+
+// starts object written at the current offset
+static void
+begin_object(pdf_writer_t *pdf, int object)
+{
+    pdf->objects[object] = emitter_tell(pdf->out);
+    emitter_int(pdf->out, object);
+    emitter_str(pdf->out, " 0 obj\n");
+}
+
+/*
+ * input: pdf - writer
+ *        dict - dictionary entries besides /Length and /Filter
+ *        data, len - stream data
+ *        compress - deflate data?
+ * output: return number of stream object, -1 if out of memory
+ */
+static int
+write_stream(pdf_writer_t *pdf, const char *dict,
+             const void *data, size_t len, int compress)
+{
+    uLongf packed_len = compressBound(len);
+    unsigned char *packed = NULL;
+    int object = new_object(pdf);
+
+    if (object < 0) return -1;
+
+    if (compress) {
+        packed = malloc(packed_len);
+        if (NULL == packed ||
+            compress2(packed, &packed_len, data, len, Z_BEST_SPEED) != Z_OK) {
+            free(packed);
+            return -1;
+        }
+        data = packed;
+        len = packed_len;
+    }
+
+    begin_object(pdf, object);
+    emitter_str(pdf->out, "<< ");
+    emitter_str(pdf->out, dict);
+    if (compress)
+        emitter_str(pdf->out, " /Filter /FlateDecode");
+    emitter_str(pdf->out, " /Length ");
+    emitter_int(pdf->out, len);
+    emitter_str(pdf->out, " >>\nstream\n");
+    emitter_bytes(pdf->out, data, len);
+    emitter_str(pdf->out, "\nendstream\nendobj\n");
+
+    free(packed);
+    return object;
+}
+
+/*
+ * input: pdf - writer
+ *        image - decoded image
+ * output: return number of image XObject, -1 if out of memory
+ */
+static int
+write_image(pdf_writer_t *pdf, const pdf_image_t *image)
+{
+    char dict[128];
+    int smask = 0;
+    int n;
+
+    if (image->alpha) {
+        snprintf(dict, sizeof(dict),
+                 "/Type /XObject /Subtype /Image /Width %d /Height %d "
+                 "/ColorSpace /DeviceGray /BitsPerComponent 8",
+                 image->width, image->height);
+        smask = write_stream(pdf, dict, image->alpha,
+                             (size_t)image->width * image->height, 1);
+        if (smask < 0) return -1;
+    }
+
+    n = snprintf(dict, sizeof(dict),
+                 "/Type /XObject /Subtype /Image /Width %d /Height %d "
+                 "/ColorSpace /DeviceRGB /BitsPerComponent 8",
+                 image->width, image->height);
+    if (smask)
+        snprintf(dict + n, sizeof(dict) - n, " /SMask %d 0 R", smask);
+
+    return write_stream(pdf, dict, image->rgb,
+                        (size_t)image->width * image->height * 3, 1);
+}
+
+/*
+ * input: pdf - writer to set up
+ *        out - where document goes, at its start
+ *        images_dir - directory of png-files
+ *        images - names of images (without .png), used as /I<name> by pages
+ *        images_nr - number of images
+ * output: return 0 - ok, -1 - fail (reported)
+ *         header, images, font and resources written
+ */
+int
+pdf_open(pdf_writer_t *pdf, emitter_t *out, const char *images_dir,
+         const char *const *images, int images_nr)
+{
+    char path[PATH_MAX];
+    pdf_image_t image;
+    int *image_objects;
+    int font;
+    int i;
+
+    memset(pdf, 0, sizeof(*pdf));
+    pdf->out = out;
+
+    // object 0 is the head of free list
+    image_objects = malloc(sizeof(int) * images_nr);
+    if (NULL == image_objects || new_object(pdf) < 0) goto no_memory;
+    pdf->pages_root = new_object(pdf);
+    if (pdf->pages_root < 0) goto no_memory;
+
+    emitter_str(out, "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n");
+
+    for (i = 0; i < images_nr; ++i) {
+        snprintf(path, sizeof(path), "%s/%s.png", images_dir, images[i]);
+        if (png_load(&image, path) < 0) {
+            free(image_objects);
+            return -1;
+        }
+        image_objects[i] = write_image(pdf, &image);
+        free(image.rgb);
+        free(image.alpha);
+        if (image_objects[i] < 0) goto no_memory;
+    }
+
+    font = new_object(pdf);
+    if (font < 0) goto no_memory;
+    begin_object(pdf, font);
+    emitter_str(out, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica "
+                     "/Encoding /WinAnsiEncoding >>\nendobj\n");
+
+    // one resources dictionary is shared by all pages
+    pdf->resources = new_object(pdf);
+    if (pdf->resources < 0) goto no_memory;
+    begin_object(pdf, pdf->resources);
+    emitter_str(out, "<< /Font << /F1 ");
+    emitter_int(out, font);
+    emitter_str(out, " 0 R >> /XObject <<");
+    for (i = 0; i < images_nr; ++i) {
+        emitter_str(out, " /I");
+        emitter_str(out, images[i]);
+        emitter_str(out, " ");
+        emitter_int(out, image_objects[i]);
+        emitter_str(out, " 0 R");
+    }
+    emitter_str(out, " >> >>\nendobj\n");
+
+    free(image_objects);
+    return 0;
+
+no_memory:
+    fprintf(stderr, "out of memory writing pdf\n");
+    free(image_objects);
+    return -1;
+}
+
+/*
+ * input: pdf - opened writer
+ *        content - page content stream
+ *        len - size of content
+ * output: return 0 - ok, -1 - out of memory
+ */
+int
+pdf_page(pdf_writer_t *pdf, const char *content, size_t len)
+{
+    int *bigger;
+    int contents, page;
+
+    if (pdf->pages_nr == pdf->pages_size) {
+        bigger = realloc(pdf->pages, sizeof(int) * (pdf->pages_size * 2 + 64));
+        if (NULL == bigger) return -1;
+        pdf->pages = bigger;
+        pdf->pages_size = pdf->pages_size * 2 + 64;
+    }
+
+    contents = write_stream(pdf, "", content, len, 1);
+    if (contents < 0) return -1;
+
+    page = new_object(pdf);
+    if (page < 0) return -1;
+    begin_object(pdf, page);
+    emitter_str(pdf->out, "<< /Type /Page /Parent ");
+    emitter_int(pdf->out, pdf->pages_root);
+    emitter_str(pdf->out, " 0 R /Resources ");
+    emitter_int(pdf->out, pdf->resources);
+    emitter_str(pdf->out, " 0 R /Contents ");
+    emitter_int(pdf->out, contents);
+    emitter_str(pdf->out, " 0 R >>\nendobj\n");
+
+    pdf->pages[pdf->pages_nr++] = page;
+    return 0;
+}
+
+/*
+ * input: pdf - opened writer
+ * output: return 0 - ok, -1 - out of memory
+ *         page tree, catalog, cross-reference table and trailer written
+ */
+int
+pdf_close(pdf_writer_t *pdf)
+{
+    char line[24];
+    size_t xref;
+    int catalog;
+    int i;
+
+    begin_object(pdf, pdf->pages_root);
+    emitter_str(pdf->out, "<< /Type /Pages /MediaBox [0 0 595.276 841.890] /Count ");
+    emitter_int(pdf->out, pdf->pages_nr);
+    emitter_str(pdf->out, " /Kids [");
+    for (i = 0; i < pdf->pages_nr; ++i) {
+        emitter_str(pdf->out, i % 8 ? " " : "\n");
+        emitter_int(pdf->out, pdf->pages[i]);
+        emitter_str(pdf->out, " 0 R");
+    }
+    emitter_str(pdf->out, " ] >>\nendobj\n");
+
+    catalog = new_object(pdf);
+    if (catalog < 0) return -1;
+    begin_object(pdf, catalog);
+    emitter_str(pdf->out, "<< /Type /Catalog /Pages ");
+    emitter_int(pdf->out, pdf->pages_root);
+    emitter_str(pdf->out, " 0 R >>\nendobj\n");
+
+    xref = emitter_tell(pdf->out);
+    emitter_str(pdf->out, "xref\n0 ");
+    emitter_int(pdf->out, pdf->objects_nr);
+    emitter_str(pdf->out, "\n0000000000 65535 f \n");
+    for (i = 1; i < pdf->objects_nr; ++i) {
+        snprintf(line, sizeof(line), "%010zu 00000 n \n", pdf->objects[i]);
+        emitter_bytes(pdf->out, line, 20);
+    }
+
+    emitter_str(pdf->out, "trailer\n<< /Size ");
+    emitter_int(pdf->out, pdf->objects_nr);
+    emitter_str(pdf->out, " /Root ");
+    emitter_int(pdf->out, catalog);
+    emitter_str(pdf->out, " 0 R >>\nstartxref\n");
+    emitter_int(pdf->out, xref);
+    emitter_str(pdf->out, "\n%%EOF\n");
+
+    return 0;
+}
+
+void
+pdf_free(pdf_writer_t *pdf)
+{
+    free(pdf->objects);
+    free(pdf->pages);
+    memset(pdf, 0, sizeof(*pdf));
+}
+
+/*
+ * input: text - utf-8 text
+ *        len - size of text
+ *        i - index of character in text
+ * output: return WinAnsi code of the character ('?' if there is none)
+ *         i - index of the next character
+ */
+static unsigned char
+next_char(const char *text, size_t len, size_t *i)
+{
+    const unsigned char *in = (const unsigned char *)text;
+    unsigned int c = in[(*i)++];
+
+    if (c < 0x80) return c;
+
+    // latin-1 supplement is the same in WinAnsi
+    if ((c & 0xe0) == 0xc0 && *i < len && (in[*i] & 0xc0) == 0x80) {
+        c = ((c & 0x1f) << 6) | (in[(*i)++] & 0x3f);
+        return c >= 0xa0 ? c : '?';
+    }
+
+    // skip continuation bytes of longer sequence
+    while (*i < len && (in[*i] & 0xc0) == 0x80) ++*i;
+    return '?';
+}
+
+/*
+ * input: out - content stream
+ *        text - utf-8 text
+ *        len - size of text
+ * output: pdf string of text in WinAnsi appended to out
+ */
+void
+pdf_text(emitter_t *out, const char *text, size_t len)
+{
+    char *to = emitter_reserve(out, 2 * len + 2);
+    size_t i = 0;
+    unsigned char c;
+
+    if (NULL == to) return;
+    *to++ = '(';
+    while (i < len) {
+        c = next_char(text, len, &i);
+        if (c == '(' || c == ')' || c == '\\')
+            *to++ = '\\';
+        *to++ = c;
+    }
+    *to++ = ')';
+
+    // reserved for the worst case
+    out->len = to - out->buf;
+}
+
+/*
+ * input: text - utf-8 text
+ *        len - size of text
+ *        size - font size
+ * output: return width of text in Helvetica of size
+ */
+double
+pdf_text_width(const char *text, size_t len, double size)
+{
+    size_t i = 0;
+    unsigned char c;
+    unsigned int width = 0;
+
+    while (i < len) {
+        c = next_char(text, len, &i);
+        width += c >= 32 && c <= 126 ? helvetica_widths[c - 32] : 556;
+    }
+
+    return width * size / 1000;
+}
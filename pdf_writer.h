@@ -0,0 +1,47 @@
+#ifndef PDF_WRITER_H
+#define PDF_WRITER_H
+
+#include <stddef.h>
+
+#include "emitter.h"
+
+// A4 in points
+#define PDF_PAGE_WIDTH 595.276
+#define PDF_PAGE_HEIGHT 841.890
+#define PDF_CM 28.3465
+
+// pdf document being written: shared resources first, then pages
+typedef struct {
+    emitter_t *out;
+    // offsets of objects by number, 0 for object not written yet
+    size_t *objects;
+    int objects_nr;
+    int objects_size;
+    // object numbers of pages
+    int *pages;
+    int pages_nr;
+    int pages_size;
+    int pages_root;
+    int resources;
+} pdf_writer_t;
+
+int
+pdf_open(pdf_writer_t *pdf, emitter_t *out, const char *images_dir,
+         const char *const *images, int images_nr);
+
+int
+pdf_page(pdf_writer_t *pdf, const char *content, size_t len);
+
+int
+pdf_close(pdf_writer_t *pdf);
+
+void
+pdf_free(pdf_writer_t *pdf);
+
+void
+pdf_text(emitter_t *out, const char *text, size_t len);
+
+double
+pdf_text_width(const char *text, size_t len, double size);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,49 +11,88 @@
 #include <limits.h>
 #include <errno.h>
 
-void standardName(char *to, char *outDir, int k)
-{
-    sprintf(to, "%s/game-%d.pgn", outDir, k);
-}
+#include "pgn_reader.h"
+#include "pgn_index.h"
 
-void whiteWinName(char *to, char *outDir, int k)
+/*
+ * output: game written to its file in outDir, with <game>.key next to it
+ *         keeping hash of raw game bytes for incremental rebuilds,
+ *         file of the same game is left untouched
+ */
+int writeGame(char *game, int game_len, char *outDir, int k,
+              enum game_result_t result)
 {
-    sprintf(to, "%s/game-%d-ww.pgn", outDir, k);
-}
+    FILE *out;
+    char outName[PATH_MAX];
+    char keyFile[PATH_MAX];
+    char key[32];
 
-void blackWinName(char *to, char *outDir, int k)
-{
-    sprintf(to, "%s/game-%d-bw.pgn", outDir, k);
-}
+    pgn_game_name(outName, outDir, k, result, ".pgn");
+    pgn_game_name(keyFile, outDir, k, result, ".key");
+    sprintf(key, "%016llx\n", (unsigned long long)pgn_hash64(game, game_len));
 
-void drawName(char *to, char *outDir, int k)
-{
-    sprintf(to, "%s/game-%d-00.pgn", outDir, k);
+    if (pgn_same_key(keyFile, key) && access(outName, F_OK) == 0)
+        return 0;
+
+    out = fopen(outName, "w");
+    if (!out) {
+        fprintf(stderr, "fopen failed for '%s': %s\n",
+                outName, strerror(errno));
+        return -1;
+    }
+
+    fwrite(game, 1, game_len, out);
+    fputc('\n', out);
+
+    fclose(out);
+
+    out = fopen(keyFile, "w");
+    if (!out) {
+        fprintf(stderr, "fopen failed for '%s': %s\n",
+                keyFile, strerror(errno));
+        return -1;
+    }
+    fputs(key, out);
+    fclose(out);
+    return 0;
 }
 
 int
 main (int argc, char **argv)
 {
-    FILE *in;
-    FILE *out;
-    char outName[PATH_MAX];
-    struct stat st;
-    char *file_data;
-    char *game, *game2, *result;
+    pgn_reader_t reader;
+    pgn_index_t index;
+    pgn_query_t query;
+    uint32_t *selected = NULL;
+    uint32_t selected_nr = 0;
+    uint32_t i;
+    char *game;
+    int game_len;
+    char *inName;
     char *outDir;
     int k = 0;
-    char *buf;
-    int lenToCopy;
     int startNum = 0, endNum = INT_MAX;
-    const char GameStart[] = "[Event";
-    const char GameResult[] = "[Result";
+    int res = 0;
+    int opt;
+
+    pgn_query_init(&query);
+    while ((opt = getopt(argc, argv, PGN_QUERY_OPTIONS)) != -1) {
+        if (pgn_query_option(&query, opt, optarg) != 1)
+            return 1;
+    }
+
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if (argc < 3) {
         fprintf(stdout,
-                "usage:    %s <in-pgn> <out-dir> [start_num end_num]\n"
-                "usage: or %s <in-pgn> <out-dir> [end_num] // start_num = 0\n"
-                "usage: or %s <in-pgn> <out-dir> // start_num = 0, end_num = INT_MAX\n"
-                "start_num and end_num are 0-based\n",
+                "usage:    %s [query] <in-pgn> <out-dir> [start_num end_num]\n"
+                "usage: or %s [query] <in-pgn> <out-dir> [end_num] // start_num = 0\n"
+                "usage: or %s [query] <in-pgn> <out-dir> // start_num = 0, end_num = INT_MAX\n"
+                "start_num and end_num are 0-based, <in-pgn> may be '-' for stdin\n"
+                "games of <in-pgn> are indexed in <in-pgn>idx for later runs\n"
+                "query - only games matching all of:\n"
+                PGN_QUERY_USAGE,
                 argv[0], argv[0], argv[0]);
         return 0;
     }
@@ -64,107 +104,54 @@ main (int argc, char **argv)
         endNum = atoi(argv[4]) + 1;
     }
 
-    if (stat(argv[1], &st) < 0) {
-        perror("cant stat input file");
+    inName = argv[1];
+    if (pgn_reader_open(&reader, inName) == failed) {
+        perror("cant open input file");
         return 1;
     }
 
-    in = fopen(argv[1], "r");
-    if (!in) {
-        perror("fopen");
-        return 1;
-    }
-
-    rewind(in);
-    file_data = malloc(st.st_size + 1);
-    fread(file_data, 1, st.st_size, in);
-    file_data[st.st_size] = '\0';
-    fclose(in);
-
     outDir = argv[2];
     if (outDir[strlen(outDir) - 1] == '/')
         outDir[strlen(outDir) - 1] = '\0';
 
-    game = strstr(file_data, GameStart);
-
-    /* skip to startNum */
-    while ((game) &&
-           (k < startNum)) {
-        game2 = strstr(game + strlen(GameStart), GameStart);
-        game = game2;
-        ++k;
-    }
-
-    while ((game) &&
-           (k < endNum)) {
-        game2 = strstr(game + strlen(GameStart), GameStart);
-
-        lenToCopy = game2 ? game2 - game : strlen(game);
-        buf = malloc(sizeof(char) * (lenToCopy + 1));
-        memcpy(buf, game, lenToCopy);
-        buf[lenToCopy] = '\0';
-        memcpy(buf, game, sizeof(char)*lenToCopy);
-
-        result = strstr(game, GameResult);
-        if (!result)
-            standardName(outName, outDir, k);
-        else {
-            char *subbuf;
-            int subbuf_len;
-            char *nl = strstr(result + strlen(GameResult), "]");
-            char *q, *q2;
-            if (!nl)
-                standardName(outName, outDir, k);
-            else {
-                subbuf_len = nl - result;
-                subbuf = malloc(sizeof(char) * (subbuf_len + 1));
-                memcpy(subbuf, result, subbuf_len);
-                subbuf[subbuf_len] = '\0';
-
-                q = strstr(subbuf, "\"");
-                if (!q)
-                    standardName(outName, outDir, k);
-                else {
-                    *q = '\0';
-                    ++q;
-                    q2 = strstr(q, "\"");
-                    if (!q2)
-                        standardName(outName, outDir, k);
-                    else {
-                        *q2 = '\0';
-                        if (strcmp(q, "1-0") == 0)
-                            whiteWinName(outName, outDir, k);
-                        else if (strcmp(q, "0-1") == 0)
-                            blackWinName(outName, outDir, k);
-                        else if (strcmp(q, "1/2-1/2") == 0)
-                            drawName(outName, outDir, k);
-                        else
-                            standardName(outName, outDir, k);
-                    }
-                }
-
-                free(subbuf);
+    if (pgn_index_open(&index, inName, &reader) == success) {
+        if (pgn_query_empty(&query)) {
+            // jump straight to startNum
+            for (k = startNum; k < endNum && k < index.games_nr && 0 == res; ++k)
+                res = writeGame(reader.data + index.games[k].offset,
+                                index.games[k].length,
+                                outDir, k, index.games[k].result);
+        } else if (pgn_index_select(&index, &query, &selected, &selected_nr) == success) {
+            for (i = 0; i < selected_nr && 0 == res; ++i) {
+                k = selected[i];
+                if (k < startNum || k >= endNum) continue;
+                res = writeGame(reader.data + index.games[k].offset,
+                                index.games[k].length,
+                                outDir, k, index.games[k].result);
             }
+            free(selected);
+        } else {
+            perror("cant select games");
+            res = 1;
         }
 
-        out = fopen(outName, "w");
-        if (!out) {
-            fprintf(stderr, "fopen failed for '%s': %s\n",
-                    outName, strerror(errno));
-            free(buf);
-            return 2;
+        pgn_index_free(&index);
+    } else if (!pgn_query_empty(&query)) {
+        fprintf(stderr, "query needs <in-pgn> to be a regular file\n");
+        res = 1;
+    } else {
+        // not a regular file, read game by game
+        while ((k < endNum) && 0 == res &&
+               (pgn_reader_next_game(&reader, &game, &game_len) == success)) {
+            /* skip to startNum */
+            if (k >= startNum)
+                res = writeGame(game, game_len, outDir, k,
+                                pgn_game_result(game, game_len));
+            ++k;
         }
+    }
 
-        fprintf(out, "%s\n", buf);
-
-        free(buf);
-
-        fclose(out);
-        game = game2;
-        ++k;
-    };
-
-    free(file_data);
+    pgn_reader_close(&reader);
 
-    return 0;
+    return res ? 2 : 0;
 }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -6,6 +7,21 @@
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <linux/limits.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "pgn_reader.h"
+#include "pgn_header.h"
+#include "pgn_index.h"
+#include "pgn_tree.h"
+#include "bitboard.h"
+#include "emitter.h"
+#include "pdf_writer.h"
 
 #define FUNCTION_STUB fprintf(stderr, "Function not implemented %s\n", __func__);
 #define NOT_IMPLEMENTED { FUNCTION_STUB; }
@@ -22,7 +38,26 @@
 
 #define POSITION(r,c) ((r&0x07)<<3)|(c&0x07)
 
-#define DELIMITERS ". \r\n"
+// king and king_moved share one bitboard
+#define BB_CLASS(class) ((class) == king_moved ? king : (class))
+
+#define SIDE_PIECES(board,color) ((color) ? (board)->real_blacks : (board)->real_whites)
+#define SQUARE_EMPTY(board,pos) (((board)->square[pos] & 0x07) == no_piece)
+#define SQUARE_COLOR(board,pos) (((board)->square[pos] >> 7) & 0x01)
+// square byte as (color << 3) | piece_type, 0..15
+#define SQUARE_CODE(square) ((((square) >> 4) & 0x08) | ((square) & 0x07))
+
+// longest move in SAN to take
+#define SAN_MAX 15
+
+// openings cached: plies from the initial position and positions
+// kept before the cache starts over
+#define OPENING_PLIES 16
+#define OPENING_NODES 4096
+
+// version of LaTeX and pdf output, to be bumped when it changes,
+// pgn2pdf.sh rebuilds games converted by other version
+#define TEMPLATE_VERSION 1
 
 const char pre_boards_str[] = "\\documentclass[12pt,a4paper,oneside,notitlepage]{book}\n\
 \\usepackage{makeidx}\n\
@@ -38,37 +73,48 @@ const char pre_boards_str[] = "\\documentclass[12pt,a4paper,oneside,notitlepage]
 \n\
 \\begin{document}\n\
 \n\
-\\newcolumntype{D}[1]{%%\n\
- >{\\vbox to 1.335cm\\bgroup\\vfill\\centering}%%\n\
- p{#1}%%\n\
+\\newcolumntype{D}[1]{%\n\
+ >{\\vbox to 1.335cm\\bgroup\\vfill\\centering}%\n\
+ p{#1}%\n\
  <{\\egroup}}\n\
-\n";
+\n\
+\\newcommand{\\PGboard}[1]{%\n\
+\\begin{tabular}{D{5mm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{15mm}D{1mm}}\n\
+&\\LARGE{a}&\\LARGE{b}&\\LARGE{c}&\\LARGE{d}&\\LARGE{e}&\\LARGE{f}&\\LARGE{g}&\\LARGE{h}&& \\\\\n\
+#1%\n\
+&\\LARGE{a}&\\LARGE{b}&\\LARGE{c}&\\LARGE{d}&\\LARGE{e}&\\LARGE{f}&\\LARGE{g}&\\LARGE{h}&& \\\\\n\
+\\end{tabular}}\n\
+\\newcommand{\\PGsq}[2]{\\expandafter\\usebox\\csname PG#1#2\\endcsname}\n\
+\\newcommand{\\PGrankb}[9]{\\LARGE{#1}&\\PGsq#2b&\\PGsq#3w&\\PGsq#4b&\\PGsq#5w&\\PGsq#6b&\\PGsq#7w&\\PGsq#8b&\\PGsq#9w& \\LARGE{#1} & \\\\}\n\
+\\newcommand{\\PGrankw}[9]{\\LARGE{#1}&\\PGsq#2w&\\PGsq#3b&\\PGsq#4w&\\PGsq#5b&\\PGsq#6w&\\PGsq#7b&\\PGsq#8w&\\PGsq#9b& \\LARGE{#1} & \\\\}\n\
+\\newcommand{\\PGsave}[2]{%\n\
+ \\ifcsname PGbox#1\\endcsname\\else\\expandafter\\newsavebox\\csname PGbox#1\\endcsname\\fi\n\
+ \\expandafter\\sbox\\csname PGbox#1\\endcsname{#2}\\PGuse{#1}}\n\
+\\newcommand{\\PGuse}[1]{\\expandafter\\usebox\\csname PGbox#1\\endcsname}\n\
+\\newcommand{\\PGplayers}{}\n\
+\\newcommand{\\PGtitle}[1]{\\begin{Large} \\PGplayers\\end{Large}\n\
+ \\linebreak~\\linebreak\\begin{Large} #1. }\n";
 
 const char post_boards_str[] = "\
 \\end{document}";
 
+// repeated position printed by reference
+const char same_board_str[] = "\
+\\newcommand{\\PGsame}[1]{\\begin{Large}same as diagram of move #1\\end{Large}}\n";
+
 const char move_before_board_str[] = "\
 \\clearpage\n";
 
+// board is \PGboard with \PGrankb/\PGrankw (a-file square black/white)
+// of every rank, squares are FEN letters, '-' for empty one
 const char board_start_str[] = "\
 \\centering\n\
-\\begin{tabular}{D{5mm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{1.58cm}D{15mm}D{1mm}}\n\
-&\\LARGE{a}&\\LARGE{b}&\\LARGE{c}&\\LARGE{d}&\\LARGE{e}&\\LARGE{f}&\\LARGE{g}&\\LARGE{h}&& \\\\\n";
+\\PGboard{%\n";
 
 const char board_finish_str[] = "\
-&\\LARGE{a}&\\LARGE{b}&\\LARGE{c}&\\LARGE{d}&\\LARGE{e}&\\LARGE{f}&\\LARGE{g}&\\LARGE{h}&& \\\\\n\
-\\end{tabular}\n";
-
-char *white_name;
-char *black_name;
+}\n";
 
 /* typedefs */
-// read_* functions result type
-typedef enum {
-    failed = 0,
-    success = 1
-} reader_result_t;
-
 // move type (who wins on the move)
 enum move_type_t {
     continous = 0x00,
@@ -116,6 +162,8 @@ typedef struct {
     enum castling_type_t castling;
     // is capture?
     char capture;
+    // pieces found to make the move before pins are checked
+    int candidates;
 } move_t;
 
 // board type
@@ -126,9 +174,17 @@ typedef struct {
     unsigned short int blacks[17];
     unsigned short int *real_whites;
     unsigned short int *real_blacks;
-    // 64 bytes of the board itself
+    // 64 bytes of the board itself, kept in sync with whites/blacks
     // calc as: square[(row << 3) + col] = (color << 7) + piece_type
     unsigned char square[64];
+    // index in whites/blacks of the piece on the square, -1 if none
+    signed char index[64];
+    // squares of pieces: pieces_bb[color][BB_CLASS(piece_type)]
+    bitboard_t pieces_bb[2][8];
+    // squares of all pieces of color
+    bitboard_t occupied[2];
+    // Zobrist hash of square, kept in sync by moves
+    uint64_t hash;
 } board_t;
 /*
  * whites/blacks each byte structure:
@@ -168,506 +224,288 @@ enum pieces_indices_t {
     king_idx = 15
 };
 
-/* functions */
-/*
- * input in - string with file-data read
- *       idx - pointer to int where to store index of starting game
- *       len - size of in string
- * output idx - index to strating game in char *in
- */
-reader_result_t
-find_next_game(char *in, int *idx, int len)
-{
-    char *found;
-    found = strstr(in+idx[0], "[Event");
-    if (NULL == found) return failed;
-
-    idx[0] = found - in;
-    return success;
-}
+// position shown in game, to tell when it repeats
+typedef struct {
+    uint64_t hash;
+    // savebox number once repeated, 0 before
+    int box;
+    // move it was shown first on
+    int move_nr;
+    int black;
+    // copy of board square, NULL for free entry
+    unsigned char *square;
+} position_t;
+
+// position after a sequence of moves from the initial position,
+// node of the trie of game beginnings
+typedef struct opening_s {
+    // move leading here
+    char san[SAN_MAX + 1];
+    int san_len;
+    // plies from the initial position
+    int ply;
+    board_t board;
+    // board printed, template patched with the squares (NULL until printed)
+    char *diagram;
+    struct opening_s *children;
+    struct opening_s *next;
+} opening_t;
+
+// beginnings of games converted before, to replay and print them once,
+// one cache for each thread converting games
+typedef struct {
+    arena_t arena;
+    // initial position, NULL when empty
+    opening_t *root;
+    int nodes_nr;
+} opening_cache_t;
+
+// stages of conversion timed for --stats
+enum stats_stage_t {
+    // finding the game in input
+    stage_scan = 0,
+    // tags and start of movetext
+    stage_header,
+    // movetext to game tree
+    stage_tree,
+    // making moves on board
+    stage_replay,
+    // LaTeX or pdf of boards
+    stage_print,
+    // game written to document
+    stage_write,
+    stages_nr
+};
 
-reader_result_t
-read_white_black(char *in, int idx, int len)
-{
-    char *found, *found2;
-    if (idx >= len) return failed;
-    in += idx;
-    found = strstr(in, "[White");
-    if (NULL != found) {
-        found = strstr(found, "\"");
-        if (NULL != found) {
-            ++found;
-            found2 = strstr(found, "\"");
-            if (NULL != found2) {
-                white_name = malloc(found2 - found+1);
-                memcpy(white_name, found, found2-found);
-                white_name[found2-found] = '\0';
-            } else {
-                white_name = strdup("?");
-            }
-        } else {
-            white_name = strdup("?");
-        }
-    } else {
-        white_name = strdup("?");
-    }
-
-    found = strstr(in, "[Black");
-    if (NULL != found) {
-        found = strstr(found, "\"");
-        if (NULL != found) {
-            ++found;
-            found2 = strstr(found, "\"");
-            if (NULL != found2) {
-                black_name = malloc(found2 - found+1);
-                memcpy(black_name, found, found2-found);
-                black_name[found2-found] = '\0';
-            } else {
-                black_name = strdup("?");
-            }
-        } else {
-            black_name = strdup("?");
-        }
-    } else {
-        black_name = strdup("?");
-    }
+// what converting a game took
+typedef struct {
+    double seconds[stages_nr];
+    unsigned long bytes;
+    unsigned long plies;
+    unsigned long candidates;
+    unsigned long emitted;
+    unsigned long allocs;
+} stats_t;
+
+// per-game conversion state, one for each game converted at a time
+typedef struct {
+    // game number in input (0-based)
+    int k;
+    // game text, owned copy when converted by worker
+    char *game;
+    int game_len;
+    int game_size;
+    // tags of the game and where its movetext starts
+    pgn_header_t header;
+    board_t board;
+    // game tree, allocated in arena and pointing into game
+    pgn_tree_t tree;
+    // everything of the game, reset when the next game is converted
+    arena_t arena;
+    // positions shown in game, open addressing in arena
+    position_t *positions;
+    int positions_size;
+    // saveboxes used by game
+    int boxes_nr;
+    // beginnings of games converted by the thread
+    opening_cache_t *openings;
+    // stats of the game, reset by whoever hands the game out
+    stats_t stats;
+    // with --verify: ply of mainline (1-based) that cannot be made
+    // and its move, 0 if game replays, -1 if movetext is not read
+    int failed_ply;
+    const pgn_move_t *failed_move;
+    // where LaTeX of the game goes
+    emitter_t *out;
+    // LaTeX of the game when rendered to memory
+    emitter_t game_out;
+    // ends of pages in game_out when writing pdf
+    size_t *page_ends;
+    int pages_nr;
+    int pages_size;
+    // when writing to games_dir: result naming the document,
+    // key of game and template, and is document built from them already?
+    enum game_result_t result;
+    char key[40];
+    int up_to_date;
+} game_ctx_t;
+
+// output document
+typedef struct {
+    emitter_t out;
+    // pdf writer when writing pdf
+    pdf_writer_t pdf;
+} doc_t;
 
-    return success;
-}
+/* functions */
+// random key of every square code on every square, hash of board
+// is xor of keys of its 64 squares
+static uint64_t zobrist[16][64];
 
-/*
- * input in - string with file-data read
- *       idx - pointer to int where to store index of movetext_section
- *       len - size of in string
- * output idx - index to movetext_section in char *in
- */
 void
-goto_moves(char *in, int *idx, int len)
+init_zobrist(void)
 {
-    int i;
-    i = idx[0];
-    while (i < len) {
-        // TODO
-        if ('[' == in[i]) {
-            while ((i < len) && (in[i] != ']')) ++i;
-            continue;
-        }
-
-        if ('\n' == in[i])
-            if ('\n' == in[i+1] && isdigit(in[i+2])) {
-                idx[0] = i + 2;
-                return;
-            }
-
-        if (isdigit(in[i])) {
-            idx[0] = i;
-            return;
+    // xorshift64 with fixed seed, hashes are the same from run to run
+    uint64_t x = 0x9e3779b97f4a7c15ull;
+    int code, place;
+
+    for (code = 0; code < 16; ++code)
+        for (place = 0; place < 64; ++place) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            zobrist[code][place] = x;
         }
-
-        ++i;
-    }
-
-    idx[0] = i;
 }
 
 /*
- * input: pieces - pieces list
- *        piece - piece type to find
- *        offset - from what index to start looking for piece
- * output: return index, or -1 if not found
+ * input: board - board to change
+ *        pos - square to change
+ *        square - new square byte
+ * output: board - square set, its hash updated
  */
-inline int
-find_piece(register unsigned short int *pieces,
-           register enum piece_t piece,
-           register int offset)
+static inline void
+set_square(board_t *board, unsigned char pos, unsigned char square)
 {
-    register int i;
-
-    if (piece == king || piece == king_moved)
-        return king_idx;
-
-    for (i = offset; i < 16; ++i)
-        if (!PIECE_CLASS_NOT_EQUAL(pieces[i], piece)) {
-            return i;
-        }
-
-    return -1;
+    board->hash ^= zobrist[SQUARE_CODE(board->square[pos])][pos] ^
+                   zobrist[SQUARE_CODE(square)][pos];
+    board->square[pos] = square;
 }
 
 /*
- * input: pieces - pieces list
+ * input: board - board to look at
+ *        color - color of piece to find
  *        pos - position to find
- *        offset - from what index to start looking for piece
- * output: return index, or -1 if not found
+ * output: return index in pieces list of color, or -1 if not found
  */
-inline int
-find_piece_by_pos(register unsigned short int *pieces,
-                  register unsigned char pos,
-                  register int offset)
+static inline int
+find_piece_by_pos(board_t *board,
+                  enum piece_color_t color,
+                  unsigned char pos)
 {
-    register int i;
-
-    for (i = offset; i < 16; ++i)
-        if (!(PIECE_PLACE(pieces[i]) ^ pos)) {
-            if (PIECE_CLASS_NOT_EQUAL(pieces[i],no_piece)) return i;
-        }
+    if (SQUARE_EMPTY(board, pos) || SQUARE_COLOR(board, pos) != color)
+        return -1;
 
-    return -1;
+    return board->index[pos];
 }
 
 /*
- * input: pieces - pieces list
- *        col - column to find
- *        piece - piece to find
- *        offset - from what index to start looking for piece
- * output: return index, or -1 if not found
+ * input: board - board to change
+ *        color - color of piece
+ *        idx - what piece
+ *        dest_pos - to what square
+ * output: board - piece moved in pieces list and on squares
  */
-inline int
-find_piece_by_col(register unsigned short int *pieces,
-                  register unsigned char col,
-                  register unsigned char piece,
-                  register int offset)
+static inline void
+move_piece(board_t *board,
+           enum piece_color_t color,
+           int idx,
+           unsigned char dest_pos)
 {
-    register int i;
-
-    for (i = offset; i < 16; ++i)
-        if (!((PIECE_PLACE(pieces[i]) & 0x07) ^ col) ) {
-            if (!PIECE_CLASS_NOT_EQUAL(pieces[i],piece)) return i;
-        }
-
-    return -1;
+    unsigned short int *pieces = SIDE_PIECES(board, color);
+    unsigned char from_pos = PIECE_PLACE(pieces[idx]);
+    bitboard_t from_dest = BB_SQUARE(from_pos) | BB_SQUARE(dest_pos);
+
+    board->pieces_bb[color][BB_CLASS(PIECE_CLASS(pieces[idx]))] ^= from_dest;
+    board->occupied[color] ^= from_dest;
+    set_square(board, dest_pos, board->square[from_pos]);
+    board->index[dest_pos] = idx;
+    set_square(board, from_pos, no_piece);
+    board->index[from_pos] = -1;
+    SET_PIECE_PLACE(pieces[idx], dest_pos);
 }
 
 /*
- * input: pieces - pieces list
- *        row - row to find
- *        piece - piece to find
- *        offset - from what index to start looking for piece
- * output: return index, or -1 if not found
+ * input: board - board to change
+ *        color - color of piece
+ *        idx - what piece, -1 is ignored
+ * output: board - piece removed from pieces list and from its square
  */
-inline int
-find_piece_by_row(register unsigned short int *pieces,
-                  register unsigned char row,
-                  register unsigned char piece,
-                  register int offset)
+static inline void
+remove_piece(board_t *board,
+             enum piece_color_t color,
+             int idx)
 {
-    register int i;
+    unsigned short int *pieces = SIDE_PIECES(board, color);
+    unsigned char pos;
+
+    if (idx < 0) return;
 
-    for (i = offset; i < 16; ++i)
-        if (!(((PIECE_PLACE(pieces[i]) >> 3) & 0x07 ) ^ row) )
-            if (!PIECE_CLASS_NOT_EQUAL(pieces[i],piece)) return i;
+    pos = PIECE_PLACE(pieces[idx]);
+    if (PIECE_CLASS(pieces[idx]) == no_piece) return;
 
-    return -1;
+    board->pieces_bb[color][BB_CLASS(PIECE_CLASS(pieces[idx]))] &= ~BB_SQUARE(pos);
+    board->occupied[color] &= ~BB_SQUARE(pos);
+    SET_PIECE_CLASS(pieces[idx], no_piece);
+    set_square(board, pos, no_piece);
+    board->index[pos] = -1;
 }
 
 /*
- * input: pieces - pieces list
+ * input: board - board to change
+ *        color - color of piece
  *        idx - what piece
- *        dest_pos - to what square
- *        capture_black - is capturing move (bit 1)? (for pawn)
- *                        is moving as blacks (bit 0)? (for pawn)
- * output: return 0 - cannot move, 1 - can move
+ *        class - new piece type (promotion, king moved)
+ * output: board - piece type changed in pieces list and on its square
  */
-inline int
-can_move(unsigned short int *pieces,
-         unsigned short int *other_pieces,
-         unsigned char idx,
-         unsigned char dest_pos,
-         unsigned char capture_black)
+static inline void
+set_piece_class(board_t *board,
+                enum piece_color_t color,
+                int idx,
+                enum piece_t class)
 {
-    register unsigned char from_col = PIECE_PLACE(pieces[idx]) & 0x07;
-    register unsigned char from_row = (PIECE_PLACE(pieces[idx]) >> 3) & 0x07;
-    register unsigned char dest_col = dest_pos & 0x07;
-    register unsigned char dest_row = (dest_pos >> 3) & 0x07;
-    register unsigned char max_row, min_row, max_col, min_col, t;
-    unsigned char temp_pos;
-    char dr, dc, d, tc, tr;
-    // TODO
-    switch (PIECE_CLASS(pieces[idx])) {
-        case pawn:
-            // white pawn move by one row
-            if ((dest_row - from_row) == 1 &&
-                (capture_black & 0x01) == 0) {
-                if (((dest_col - from_col) == 1 ||
-                     (from_col - dest_col) == 1) &&
-                    (capture_black & 0x02) != 0) {
-                    return 1;
-                }
-
-                if ((dest_col == from_col) &&
-                    (capture_black & 0x02) == 0) {
-                    return 1;
-                }
-            }
-
-            // black pawn move by one row
-            if ((from_row - dest_row) == 1 &&
-                (capture_black & 0x01) != 0) {
-                if (((dest_col - from_col) == 1 ||
-                     (from_col - dest_col) == 1) &&
-                    (capture_black & 0x02) != 0) {
-                    return 1;
-                }
-
-                if ((dest_col == from_col) &&
-                    (capture_black & 0x02) == 0) {
-                    return 1;
-                }
-            }
-
-            // white pawn move by two rows
-            if ((dest_row - from_row) == 2 && (dest_col == from_col) &&
-                (capture_black & 0x01) == 0 && (capture_black & 0x02) == 0) {
-                if (from_row == 1) {
-                    temp_pos = POSITION(2,dest_col);
-                    if (find_piece_by_pos(pieces,temp_pos,0) != -1)
-                        return 0;
-                    return 1;
-                }
-            }
-
-            // black pawn move by two rows
-            if ((from_row - dest_row) == 2 && (dest_col == from_col) &&
-                (capture_black & 0x01) != 0 && (capture_black & 0x02) == 0) {
-                if (from_row == 6) {
-                    temp_pos = POSITION(5,dest_col);
-                    if (find_piece_by_pos(pieces,temp_pos,0) != -1)
-                        return 0;
-                    return 1;
-                }
-            }
-
-            return 0;
-            break;
-
-        case rook:
-            if ((dest_col != from_col) &&
-                (dest_row == from_row)) {
-                if (dest_col > from_col) {
-                    max_col = dest_col;
-                    min_col = from_col;
-                } else {
-                    max_col = from_col;
-                    min_col = dest_col;
-                }
-
-                for (t = min_col+1; t < max_col; ++t ) {
-                    temp_pos = POSITION(dest_row,t);
-                    if (find_piece_by_pos(pieces,temp_pos,0) != -1) return 0;
-                    if (find_piece_by_pos(other_pieces,temp_pos,0) != -1) return 0;
-                }
-
-                return 1;
-            }
-
-            if ((dest_col == from_col) &&
-                (dest_row != from_row)) {
-                if (dest_row > from_row) {
-                    max_row = dest_row;
-                    min_row = from_row;
-                } else {
-                    max_row = from_row;
-                    min_row = dest_row;
-                }
-
-                for (t = min_row+1; t < max_row; ++t ) {
-                    temp_pos = POSITION(t,dest_col);
-                    if (find_piece_by_pos(pieces,temp_pos,0) != -1) return 0;
-                    if (find_piece_by_pos(other_pieces,temp_pos,0) != -1) return 0;
-                }
-
-                return 1;
-            }
-
-            return 0;
-            break;
-
-        case knight:
-            if (dest_row > from_row) {
-                max_row = dest_row;
-                min_row = from_row;
-            } else {
-                max_row = from_row;
-                min_row = dest_row;
-            }
-
-            if (dest_col > from_col) {
-                max_col = dest_col;
-                min_col = from_col;
-            } else {
-                max_col = from_col;
-                min_col = dest_col;
-            }
-
-            if ((max_row - min_row) == 2 &&
-                (max_col - min_col) == 1) return 1;
-
-            if ((max_row - min_row) == 1 &&
-                (max_col - min_col) == 2) return 1;
-
-            return 0;
-            break;
-
-        case bishop:
-            // TODO: check if there is no piece standing on the way
-            if (dest_row > from_row) {
-                max_row = dest_row;
-                min_row = from_row;
-                dr = +1;
-            } else {
-                max_row = from_row;
-                min_row = dest_row;
-                dr = -1;
-            }
-
-            if (dest_col > from_col) {
-                max_col = dest_col;
-                min_col = from_col;
-                dc = +1;
-            } else {
-                max_col = from_col;
-                min_col = dest_col;
-                dc = -1;
-            }
-
-            if ((max_col - min_col) == (max_row - min_row)) {
-                d = max_col - min_col;
-                tr = from_row + dr;
-                tc = from_col + dc;
-                for (t = 1; t < d; ++t) {
-                    temp_pos = POSITION(tr, tc);
-                    if (find_piece_by_pos(pieces, temp_pos, 0) != -1) return 0;
-                    if (find_piece_by_pos(other_pieces,temp_pos,0) != -1) return 0;
-
-                    tr += dr;
-                    tc += dc;
-                }
-                return 1;
-            }
-
-            return 0;
-            break;
-
-        case queen:
-            // if moving as rook
-            if ((dest_col != from_col) &&
-                (dest_row == from_row)) {
-                if (dest_col > from_col) {
-                    max_col = dest_col;
-                    min_col = from_col;
-                } else {
-                    max_col = from_col;
-                    min_col = dest_col;
-                }
-
-                for (t = min_col+1; t < max_col; ++t ) {
-                    temp_pos = POSITION(dest_row,t);
-                    if (find_piece_by_pos(pieces,temp_pos,0) != -1) return 0;
-                    if (find_piece_by_pos(other_pieces,temp_pos,0) != -1) return 0;
-                }
-
-                return 1;
-            }
-
-            if ((dest_col == from_col) &&
-                (dest_row != from_row)) {
-                if (dest_row > from_row) {
-                    max_row = dest_row;
-                    min_row = from_row;
-                } else {
-                    max_row = from_row;
-                    min_row = dest_row;
-                }
-
-                for (t = min_row+1; t < max_row; ++t ) {
-                    temp_pos = POSITION(t,dest_col);
-                    if (find_piece_by_pos(pieces,temp_pos,0) != -1) return 0;
-                    if (find_piece_by_pos(other_pieces,temp_pos,0) != -1) return 0;
-                }
-
-                return 1;
-            }
-
-            // or moving as a bishop
-            if (dest_row > from_row) {
-                max_row = dest_row;
-                min_row = from_row;
-                dr = +1;
-            } else {
-                max_row = from_row;
-                min_row = dest_row;
-                dr = -1;
-            }
-
-            if (dest_col > from_col) {
-                max_col = dest_col;
-                min_col = from_col;
-                dc = +1;
-            } else {
-                max_col = from_col;
-                min_col = dest_col;
-                dc = -1;
-            }
-
-            if ((max_col - min_col) == (max_row - min_row)) {
-                d = max_col - min_col;
-                tr = from_row + dr;
-                tc = from_col + dc;
-                for (t = 1; t < d; ++t) {
-                    temp_pos = POSITION(tr, tc);
-                    if (find_piece_by_pos(pieces, temp_pos, 0) != -1) return 0;
-                    if (find_piece_by_pos(other_pieces,temp_pos,0) != -1) return 0;
-
-                    tr += dr;
-                    tc += dc;
-                }
-                return 1;
-            }
-
-            return 0;
-            break;
-
-        case king_moved:
-        case king:
-            if (dest_row > from_row) {
-                max_row = dest_row;
-                min_row = from_row;
-            } else {
-                max_row = from_row;
-                min_row = dest_row;
-            }
-
-            if (dest_col > from_col) {
-                max_col = dest_col;
-                min_col = from_col;
-            } else {
-                max_col = from_col;
-                min_col = dest_col;
-            }
-
-            if ((max_col - min_col) == 0 &&
-                (max_row - min_row) == 0) return 0;
-
-            if ((max_col - min_col) <= 1 &&
-                (max_row - min_row) <= 1) return 1;
+    unsigned short int *pieces = SIDE_PIECES(board, color);
+    bitboard_t pos = BB_SQUARE(PIECE_PLACE(pieces[idx]));
 
-            return 0;
-            break;
-    }
+    board->pieces_bb[color][BB_CLASS(PIECE_CLASS(pieces[idx]))] &= ~pos;
+    board->pieces_bb[color][BB_CLASS(class)] |= pos;
+    SET_PIECE_CLASS(pieces[idx], class);
+    set_square(board, PIECE_PLACE(pieces[idx]), (color << 7) | class);
+}
 
-    return 0;
+/*
+ * input: board - board to look at
+ *        pos - square to check
+ *        black - side the square is attacked from is not black (bit 0)
+ *        occupied - squares blocking rooks, bishops and queens
+ *        removed - squares of enemy pieces to ignore (captured)
+ * output: return 1 if an enemy piece attacks pos, 0 otherwise
+ */
+static inline int
+square_attacked(board_t *board,
+                unsigned char pos,
+                char black,
+                bitboard_t occupied,
+                bitboard_t removed)
+{
+    bitboard_t *enemy = board->pieces_bb[!black];
+
+    return 0 != (((bb_pawn_attacks[black & 1][pos] & enemy[pawn]) |
+                  (bb_knight_attacks[pos] & enemy[knight]) |
+                  (bb_king_attacks[pos] & enemy[king]) |
+                  (bb_bishop_attacks(pos, occupied) & (enemy[bishop] | enemy[queen])) |
+                  (bb_rook_attacks(pos, occupied) & (enemy[rook] | enemy[queen]))) &
+                 ~removed);
 }
 
-inline int
+static inline int
 castling_move(char *move_str,
-              unsigned short int *pieces,
+              board_t *board,
               move_t *move,
               char black)
 {
+    unsigned short int *pieces = SIDE_PIECES(board, black);
+    bitboard_t occupied = board->occupied[0] | board->occupied[1];
     register unsigned char temp_pos;
+    unsigned char king_pos, rook_pos;
      //  if king ever moved
     if (PIECE_CLASS_NOT_EQUAL(pieces[king_idx], king))
         return -1;
+    king_pos = PIECE_PLACE(pieces[king_idx]);
+
+    // king cannot castle out of, through or into check
+    if (square_attacked(board, king_pos, black, occupied, 0))
+        return -1;
 
     // perform castling
     if (move->castling & 0x01) {
@@ -675,197 +513,170 @@ castling_move(char *move_str,
         // choose kingside rook
         if (PIECE_CLASS_NOT_EQUAL(pieces[rook_king_idx], rook))
             return -1;
+        rook_pos = PIECE_PLACE(pieces[rook_king_idx]);
+        if (rook_pos != king_pos + 3 ||
+            (bb_between[king_pos][rook_pos] & occupied) ||
+            square_attacked(board, king_pos + 1, black, occupied, 0) ||
+            square_attacked(board, king_pos + 2, black, occupied, 0))
+            return -1;
 
         // do the castling
         temp_pos = PIECE_PLACE(pieces[king_idx]) + 2;
-        SET_PIECE_PLACE(pieces[king_idx], temp_pos);
+        move_piece(board, black, king_idx, temp_pos);
 
         temp_pos = PIECE_PLACE(pieces[rook_king_idx]) - 2;
-        SET_PIECE_PLACE(pieces[rook_king_idx], temp_pos);
+        move_piece(board, black, rook_king_idx, temp_pos);
     } else {
         // queenside castling
         // choose kingside rook
         if (PIECE_CLASS_NOT_EQUAL(pieces[rook_queen_idx], rook))
             return -1;
+        rook_pos = PIECE_PLACE(pieces[rook_queen_idx]);
+        if (rook_pos + 4 != king_pos ||
+            (bb_between[king_pos][rook_pos] & occupied) ||
+            square_attacked(board, king_pos - 1, black, occupied, 0) ||
+            square_attacked(board, king_pos - 2, black, occupied, 0))
+            return -1;
 
         // do the castling
         temp_pos = PIECE_PLACE(pieces[king_idx]) - 2;
-        SET_PIECE_PLACE(pieces[king_idx], temp_pos);
+        move_piece(board, black, king_idx, temp_pos);
 
         temp_pos = PIECE_PLACE(pieces[rook_queen_idx]) + 3;
-        SET_PIECE_PLACE(pieces[rook_queen_idx], temp_pos);
+        move_piece(board, black, rook_queen_idx, temp_pos);
     }
 
-    SET_PIECE_CLASS(pieces[king_idx], king_moved);
+    set_piece_class(board, black, king_idx, king_moved);
     return 0;
 }
 
-inline int
-capturing_move(char *move_str,
-               unsigned short int *pieces,
-               unsigned short int *other_pieces,
-               move_t *move,
-               char black,
-               char *temp_found)
+/*
+ * input: board - board to look at
+ *        class - type of piece to move
+ *        dest_pos - to what square
+ *        black - moving as blacks? (bit 0)
+ *        capture - is capturing move?
+ * output: return squares of pieces of the type that can move to dest_pos
+ */
+static inline bitboard_t
+move_candidates(board_t *board,
+                enum piece_t class,
+                unsigned char dest_pos,
+                char black,
+                char capture)
 {
-    char piece_char;
-    register int temp_idx, temp_idx2;
-    register unsigned char temp_pos;
-    register unsigned char dest_pos;
-    register int move_str_len;
-    move->capture = 1;
-    dest_pos = POSITION(temp_found[2] - 0x31, temp_found[1] - 'a');
-
-    // check for hints before 'x'
-    if (temp_found - move_str == 3) {
-        // like 'Ng5xf7'
-        temp_pos = POSITION(move_str[2] - 0x31, move_str[1] - 'a');
-        // find piece with position dest_pos
-        temp_idx = find_piece_by_pos(other_pieces, dest_pos, 0);
-        SET_PIECE_CLASS(other_pieces[temp_idx], no_piece);
-
-        temp_idx = find_piece_by_pos(pieces, temp_pos, 0);
-        SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-        return 0;
-    }
-
-    if (temp_found - move_str == 2) {
-        // like Rgxa8
-        if (isalpha(move_str[1])) {
-            temp_idx = -1;
+    bitboard_t occupied = board->occupied[0] | board->occupied[1];
+    bitboard_t pieces = board->pieces_bb[black][BB_CLASS(class)];
+    bitboard_t from;
 
-            do {
-                temp_idx = find_piece_by_col(pieces,
-                                             move_str[1] - 'a',
-                                             move->piece,
-                                             temp_idx + 1);
-
-                if (temp_idx < 0)
-                    return -1;
-            } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black | 0x02));
-
-            // temp_idx is index to piece that can move to dest_pos
-            temp_idx2 = find_piece_by_pos(other_pieces, dest_pos, 0);
-            SET_PIECE_CLASS(other_pieces[temp_idx2], no_piece);
-            SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-            return 0;
-        }
+    switch (class) {
+        case pawn:
+            if (capture)
+                return bb_pawn_attacks[!black][dest_pos] & pieces;
+
+            // push by one row, or by two rows over empty square
+            if (black) {
+                from = BB_SQUARE(dest_pos) << 8;
+                if (!(from & pieces) && (dest_pos >> 3) == 4 && !(from & occupied))
+                    from <<= 8;
+            } else {
+                from = BB_SQUARE(dest_pos) >> 8;
+                if (!(from & pieces) && (dest_pos >> 3) == 3 && !(from & occupied))
+                    from >>= 8;
+            }
+            return from & pieces;
 
-        // like 'R2xa8
-        if (isdigit(move_str[1])) {
-            temp_idx = -1;
+        case knight:
+            return bb_knight_attacks[dest_pos] & pieces;
 
-            do {
-                temp_idx = find_piece_by_row(pieces,
-                                             move_str[1] - 0x31,
-                                             move->piece,
-                                             temp_idx + 1);
+        case bishop:
+            return bb_bishop_attacks(dest_pos, occupied) & pieces;
 
-                if (temp_idx < 0)
-                    return -1;
-            } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black | 0x02));
+        case rook:
+            return bb_rook_attacks(dest_pos, occupied) & pieces;
 
-            // temp_idx is index to piece that can move to dest_pos
-            temp_idx2 = find_piece_by_pos(other_pieces, dest_pos, 0);
-            SET_PIECE_CLASS(other_pieces[temp_idx2], no_piece);
-            SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-            return 0;
-        }
+        case queen:
+            return (bb_rook_attacks(dest_pos, occupied) |
+                    bb_bishop_attacks(dest_pos, occupied)) & pieces;
 
-        return -1;
+        case king:
+        case king_moved:
+            return bb_king_attacks[dest_pos] & pieces;
     }
 
-    if (temp_found - move_str == 1) {
-        // check for pawn capture and en passant capture
-        if (move->piece == pawn) {
-            // like 'exf5'
-            // find pawn that can move to dest_pos
-            temp_idx = -1;
-            do {
-                temp_idx = find_piece_by_col(pieces,
-                                             move_str[0] - 'a',
-                                             move->piece,
-                                             temp_idx + 1);
-
-                if (temp_idx < 0) return -1;
-            } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black | 0x02));
-
-            // catch pawn captures and en passant captures
-            temp_idx2 = find_piece_by_pos(other_pieces, dest_pos, 0);
-            if (temp_idx2 == -1) {
-                // en passant capture
-                // check for pawn on delta_row from dest_pos
-                if (black) temp_pos = dest_pos + 1 * 8;
-                else temp_pos = dest_pos - 1 * 8;
-
-                temp_idx2 = find_piece_by_pos(other_pieces, temp_pos, 0);
-                if (temp_idx2 == -1) return -1;
-                if (PIECE_CLASS_NOT_EQUAL(pieces[temp_idx2], pawn)) return -1;
-            }
-            // pawn capture
-            SET_PIECE_CLASS(other_pieces[temp_idx2], no_piece);
-            SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-
-            if (move->target_piece != no_piece)
-                SET_PIECE_CLASS(pieces[temp_idx], move->target_piece);
-
-            return 0;
-        }
+    return 0;
+}
 
-        // like Nxg5
-        temp_idx = -1;
-        do {
-            temp_idx = find_piece(pieces,
-                                  move->piece,
-                                  temp_idx + 1);
+/*
+ * input: board - board to look at
+ *        black - side to find pinned pieces of (bit 0)
+ * output: return squares of pieces of the side that shield their king
+ *         from enemy rook, bishop or queen and so cannot leave the line
+ */
+static inline bitboard_t
+pinned_pieces(board_t *board, char black)
+{
+    bitboard_t occupied = board->occupied[0] | board->occupied[1];
+    bitboard_t snipers, shield;
+    bitboard_t pinned = 0;
+    int king_pos, sniper_pos;
 
-            if (temp_idx < 0)
-                return -1;
-        } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black | 0x02));
+    if (!board->pieces_bb[black][king])
+        return 0;
+    king_pos = BB_FIRST(board->pieces_bb[black][king]);
 
-        // temp_idx is index to piece that can move to dest_pos
-        temp_idx2 = find_piece_by_pos(other_pieces, dest_pos, 0);
-        // temp_idx2 is index to piece that is at the dest_pos
-        SET_PIECE_CLASS(other_pieces[temp_idx2], no_piece);
-        SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
+    // enemy sliders on an empty-board ray from the king
+    snipers = (bb_rook_attacks(king_pos, 0) &
+               (board->pieces_bb[!black][rook] | board->pieces_bb[!black][queen])) |
+              (bb_bishop_attacks(king_pos, 0) &
+               (board->pieces_bb[!black][bishop] | board->pieces_bb[!black][queen]));
 
-        if (PIECE_CLASS(pieces[temp_idx]) == king)
-            SET_PIECE_CLASS(pieces[temp_idx], king_moved);
+    while (snipers) {
+        sniper_pos = BB_FIRST(snipers);
+        snipers &= snipers - 1;
 
-        return 0;
+        shield = bb_between[king_pos][sniper_pos] & occupied;
+        if (shield && !(shield & (shield - 1)) && (shield & board->occupied[black]))
+            pinned |= shield;
     }
 
-    return -1;
+    return pinned;
 }
 
 /*
  * input: move_str - move representation (white/black)
- *        pieces - pieces list (white/black)
- *        other_pieces - pieces of other player (black/white)
+ *        board - board to make move on
  *        move - move structure
  *        black - moving as blacks? (bit 0)
  * output: return result - 0 - ok, != 0 - fail
  *                move - move structure
+ *                board - board after the move
  */
 static int
 parse_move(char *move_str,
-           unsigned short int *pieces,
-           unsigned short int* other_pieces,
+           board_t *board,
            move_t *move,
            char black)
 {
+    unsigned short int *pieces = SIDE_PIECES(board, black);
     char piece_char;
     char *temp_found;
     register int temp_idx, temp_idx2;
     register unsigned char temp_pos;
     register unsigned char dest_pos;
+    unsigned char dest_row, dest_col;
     register int move_str_len;
+    bitboard_t hints, candidates, pinned;
+    bitboard_t occupied, captured;
+    unsigned char from_pos;
+    int king_pos;
     int result;
 
     if (islower(move_str[0])) piece_char = 'P';
     else piece_char = move_str[0];
 
     move->castling = no_castling;
+    move->candidates = 0;
 
     switch (piece_char) {
         case 'P' :
@@ -897,14 +708,14 @@ parse_move(char *move_str,
 
         case 'O' :
             move->piece = no_piece;
-            move->castling = streq(move_str, "O-O-O") ?
+            move->castling = !strncmp(move_str, "O-O-O", 5) ?
                              queenside_castling :
                              kingside_castling;
             break;
 
         case '0' :
             move->piece = no_piece;
-            move->castling = streq(move_str, "0-0-0") ?
+            move->castling = !strncmp(move_str, "0-0-0", 5) ?
                              queenside_castling :
                              kingside_castling;
             break;
@@ -916,7 +727,7 @@ parse_move(char *move_str,
     }
 
     if (move->castling) {
-        result = castling_move(move_str, pieces, move, black);
+        result = castling_move(move_str, board, move, black);
         return result;
     }
 
@@ -941,7 +752,7 @@ parse_move(char *move_str,
     if (NULL != temp_found) {
         temp_found[0] = '\0';
         ++temp_found;
-        switch (temp_found[1]) {
+        switch (temp_found[0]) {
             case 'Q' :
                 move->target_piece = queen;
                 break;
@@ -983,299 +794,803 @@ parse_move(char *move_str,
     temp_found = strstr(move_str, "{");
     if (NULL != temp_found)
         temp_found[0] = '\0';
-    // check move types:
-    //      - capture move
-    temp_found = strstr(move_str, "x");
-
-    if (NULL != temp_found) {
-        // it is capturing move
-        result = capturing_move(move_str, pieces, other_pieces, move, black, temp_found);
-        return result;
-    }
-    move->capture = 0;
+    // what is left is [from-square hints][x]<dest-square>
+    if (move->piece != pawn) ++move_str;
+    move_str_len = strlen(move_str);
+    if (move_str_len < 2) return -1;
 
-    // TODO: general move
-    // look for hints for from-square
-    if (move->piece == pawn) {
-        // if moving pawn there should be no hints, then
-        dest_pos = POSITION(move_str[1] - 0x31, move_str[0] - 'a');
-        // find the pawn that can move to dest_pos
-        temp_idx = -1;
-        do {
-            temp_idx = find_piece(pieces,
-                                  move->piece,
-                                  temp_idx + 1);
+    dest_col = move_str[move_str_len - 2] - 'a';
+    dest_row = move_str[move_str_len - 1] - '1';
+    if (dest_col > 7 || dest_row > 7) return -1;
+    dest_pos = POSITION(dest_row, dest_col);
 
-            if (temp_idx < 0)
-                return -1;
-        } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black));
+    move->capture = 0;
+    hints = ~(bitboard_t)0;
+    for (temp_found = move_str; temp_found < move_str + move_str_len - 2; ++temp_found) {
+        if (*temp_found >= 'a' && *temp_found <= 'h')
+            hints &= BB_FILE(*temp_found - 'a');
+        else if (*temp_found >= '1' && *temp_found <= '8')
+            hints &= BB_RANK(*temp_found - '1');
+        else if (*temp_found == 'x')
+            move->capture = 1;
+        else
+            return -1;
+    }
 
-        // move the pawn
-        SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-        if (move->target_piece != no_piece)
-            SET_PIECE_CLASS(pieces[temp_idx], move->target_piece);
+    // own piece cannot be taken, enemy one only with 'x'
+    if (board->occupied[black] & BB_SQUARE(dest_pos))
+        return -1;
+    if (!move->capture && (board->occupied[!black] & BB_SQUARE(dest_pos)))
+        return -1;
 
-        return 0;
-    }
+    candidates = move_candidates(board, move->piece, dest_pos,
+                                 black, move->capture) & hints;
+    move->candidates = BB_COUNT(candidates);
+    if (!candidates)
+        return -1;
 
-    move_str_len = strlen(move_str);
-    dest_pos = POSITION(move_str[move_str_len - 1] - 0x31, move_str[move_str_len - 2] - 'a');
-
-    if (move_str_len == 4) {
-        // like Ngf7
-        if (isalpha(move_str[1])) {
-            temp_idx = -1;
-            do {
-                temp_idx = find_piece_by_col(pieces,
-                                             move_str[1] - 'a',
-                                             move->piece,
-                                             temp_idx + 1);
-
-                if (temp_idx < 0)
-                    return -1;
-            } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black));
-
-            // move the piece
-            SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-            return 0;
+    // SAN names a single legal move, so when several pieces reach
+    // dest_pos drop those pinned against king off the line of move
+    if (candidates & (candidates - 1)) {
+        pinned = pinned_pieces(board, black) & candidates;
+        king_pos = BB_FIRST(board->pieces_bb[black][king]);
+        while (pinned) {
+            temp_pos = BB_FIRST(pinned);
+            pinned &= pinned - 1;
+            if (!(bb_line[king_pos][temp_pos] & BB_SQUARE(dest_pos)))
+                candidates &= ~BB_SQUARE(temp_pos);
         }
+        if (!candidates)
+            return -1;
+    }
 
-        // like N5f7
-        if (isdigit(move_str[1])) {
-            temp_idx = -1;
-            do {
-                temp_idx = find_piece_by_row(pieces,
-                                             move_str[1] - 0x31,
-                                             move->piece,
-                                             temp_idx + 1);
-
-                if (temp_idx < 0)
-                    return -1;
-            } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black));
-
-            // move the piece
-            SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
-            return 0;
+    from_pos = BB_FIRST(candidates);
+    temp_idx = board->index[from_pos];
+
+    temp_idx2 = -1;
+    captured = 0;
+    if (move->capture) {
+        temp_pos = dest_pos;
+        temp_idx2 = find_piece_by_pos(board, !black, dest_pos);
+        if (temp_idx2 == -1) {
+            // en passant capture
+            // check for pawn on delta_row from dest_pos
+            if (move->piece != pawn) return -1;
+            if (black) temp_pos = dest_pos + 1 * 8;
+            else temp_pos = dest_pos - 1 * 8;
+
+            temp_idx2 = find_piece_by_pos(board, !black, temp_pos);
+            if (temp_idx2 == -1) return -1;
+            if (PIECE_CLASS_NOT_EQUAL(SIDE_PIECES(board, !black)[temp_idx2], pawn))
+                return -1;
         }
+        if (BB_CLASS(PIECE_CLASS(SIDE_PIECES(board, !black)[temp_idx2])) == king)
+            return -1;
+        captured = BB_SQUARE(temp_pos);
+    }
 
-        return -1;
+    // own king is not left in check
+    if (board->pieces_bb[black][king]) {
+        occupied = ((board->occupied[0] | board->occupied[1]) &
+                    ~(BB_SQUARE(from_pos) | captured)) | BB_SQUARE(dest_pos);
+        king_pos = BB_CLASS(move->piece) == king ?
+                   dest_pos : BB_FIRST(board->pieces_bb[black][king]);
+        if (square_attacked(board, king_pos, black, occupied, captured))
+            return -1;
     }
 
-    if (move_str_len == 3) {
-        // like Nf7
-        temp_idx = -1;
-        do {
-            temp_idx = find_piece(pieces,
-                                  move->piece,
-                                  temp_idx + 1);
+    if (move->capture)
+        remove_piece(board, !black, temp_idx2);
 
-            if (temp_idx < 0)
-                return -1;
-        } while (!can_move(pieces, other_pieces, temp_idx, dest_pos, black));
+    move_piece(board, black, temp_idx, dest_pos);
 
-        // move the piece
-        SET_PIECE_PLACE(pieces[temp_idx], dest_pos);
+    if (move->target_piece != no_piece)
+        set_piece_class(board, black, temp_idx, move->target_piece);
 
-        return 0;
-    }
+    if (PIECE_CLASS(pieces[temp_idx]) == king)
+        set_piece_class(board, black, temp_idx, king_moved);
 
-    return -1;
+    return 0;
 }
 
 /*
- * input: board - board to convert to 64 byte array
- * output: board - board with refreshed 64 byte array
+ * input: board - board with pieces lists set
+ * output: board - square and index filled from pieces lists,
+ *                 moves keep them in sync afterwards
  */
 void
-convert_board(board_t *board)
+sync_squares(board_t *board)
 {
     unsigned char place;
     unsigned char class;
     int i;
-    enum piece_color_t color;
-    // write zeros first
-    bzero(board->square, sizeof(board->square));
+
     // set all squares of board to no_piece
     memset(board->square, no_piece, sizeof(board->square));
+    memset(board->index, -1, sizeof(board->index));
+    memset(board->pieces_bb, 0, sizeof(board->pieces_bb));
+    memset(board->occupied, 0, sizeof(board->occupied));
 
-    color = white;
     for (i = 0; i < 16; ++i) {
         place = PIECE_PLACE(board->real_whites[i]);
         class = PIECE_CLASS(board->real_whites[i]);
         if (class == no_piece) continue;
-        board->square[place] = (color<<7) | class;
+        board->square[place] = (white<<7) | class;
+        board->index[place] = i;
+        board->pieces_bb[white][BB_CLASS(class)] |= BB_SQUARE(place);
+        board->occupied[white] |= BB_SQUARE(place);
     }
 
-    color = black;
     for (i = 0; i < 16; ++i) {
         place = PIECE_PLACE(board->real_blacks[i]);
         class = PIECE_CLASS(board->real_blacks[i]);
         if (class == no_piece) continue;
-        board->square[place] = (color<<7) | class;
+        board->square[place] = (black<<7) | class;
+        board->index[place] = i;
+        board->pieces_bb[black][BB_CLASS(class)] |= BB_SQUARE(place);
+        board->occupied[black] |= BB_SQUARE(place);
     }
+
+    board->hash = 0;
+    for (place = 0; place < 64; ++place)
+        board->hash ^= zobrist[SQUARE_CODE(board->square[place])][place];
 }
 
-void
-print_board(FILE* out,
-            board_t *board,
-            const char *move_str,
-            int black,
-            int move_nr)
-{
-    int row, col;
-    char fig_name[4];
-    unsigned char place;
-    unsigned char class;
-    enum piece_color_t color;
-    char square_color[2] = {
-        [0] = 'b',
-        [1] = 'w'
-    };
+// ranks of board with letter of every square to be patched
+static char board_template[256];
+static int board_template_len;
+static unsigned short square_offset[64];
+// square letter by (color << 3) | piece_type
+static const char square_letters[16] = "PRNBQKK-prnbqkk-";
+// savebox of every square image, named PG<letter><square color>
+static char square_macros[8192];
+static int square_macros_len;
+// image names (like "wpb") by (color << 3) | piece_type and square color
+static char square_images[16][2][4];
+// distinct image names, pdf has them as /I<name>
+static const char *image_names[26];
+static int image_names_nr;
+
+// pdf layout, in points
+#define PDF_SQUARE (2 * PDF_CM)
+#define PDF_BOARD_X ((PDF_PAGE_WIDTH - 8 * PDF_SQUARE) / 2)
+// board goes right under the caption and file letters
+#define PDF_BOARD_Y (PDF_CAPTION_Y - 2.5 * PDF_CAPTION_SIZE - \
+                     1.5 * PDF_LABEL_SIZE - 8 * PDF_SQUARE)
+// \Large and \LARGE of 12pt document
+#define PDF_CAPTION_SIZE 17.28
+#define PDF_LABEL_SIZE 20.74
+#define PDF_CAPTION_Y (PDF_PAGE_HEIGHT - PDF_CM - PDF_CAPTION_SIZE)
+
+// labels and squares of pdf board with image name of every square
+// to be patched like square letters of board_template
+static char pdf_board_template[8192];
+static int pdf_board_template_len;
+static unsigned short pdf_square_offset[64];
+
+// write pdf instead of LaTeX?
+static int pdf_output;
+// where images of squares are, for pdf
+static const char *pics_dir;
+// print repeated positions as reference to their first diagram?
+static int by_reference;
+// directory of per-game documents named like pgn2dir's, NULL if none
+static const char *games_dir;
+// only replay games to find those failing? (--verify)
+static int verify_only;
+static unsigned long verify_games;
+static unsigned long verify_failed;
+// where --stats report goes, NULL without --stats
+static FILE *stats_file;
+// stats of all games written
+static stats_t stats_total;
+static unsigned long stats_games;
+
+static const char *stage_names[stages_nr] = {
+    "scan", "header", "tree", "replay", "print", "write"
+};
 
-    char piece_color[2] = {
-        [1] = 'b',
-        [0] = 'w'
-    };
+/*
+ * output: return monotonic time in seconds, 0 without --stats
+ */
+static inline double
+stats_clock(void)
+{
+    struct timespec ts;
 
-    fprintf(out, move_before_board_str);
+    if (NULL == stats_file) return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-    fprintf(out,
-            "\\begin{Large} %s~---~%s \\end{Large}\n\\linebreak~\\linebreak\
-\\begin{Large} %d. \\verb|%s| \\end{Large}\n",
-            white_name,
-            black_name,
-            move_nr,
-            move_str);
+/*
+ * input: out - --stats report
+ *        stats - stats to print
+ * output: counters and seconds of stages printed as JSON members
+ */
+static void
+print_stats(FILE *out, const stats_t *stats)
+{
+    int i;
+
+    fprintf(out, "\"bytes\": %lu, \"plies\": %lu, \"candidates\": %lu, "
+            "\"emitted\": %lu, \"allocs\": %lu, \"seconds\": {",
+            stats->bytes, stats->plies, stats->candidates,
+            stats->emitted, stats->allocs);
+    for (i = 0; i < stages_nr; ++i)
+        fprintf(out, "%s\"%s\": %.6f", i ? ", " : "",
+                stage_names[i], stats->seconds[i]);
+    fprintf(out, "}");
+}
+
+/*
+ * input: out - --stats report
+ *        ctx - context of game written
+ * output: game stats added to report and to totals
+ */
+static void
+stats_game(FILE *out, const game_ctx_t *ctx)
+{
+    int i;
 
-    fprintf(out, board_start_str);
+    fprintf(out, "%s  {\"game\": %d, ", stats_games ? ",\n" : "", ctx->k);
+    print_stats(out, &ctx->stats);
+    fprintf(out, "}");
+
+    ++stats_games;
+    for (i = 0; i < stages_nr; ++i)
+        stats_total.seconds[i] += ctx->stats.seconds[i];
+    stats_total.bytes += ctx->stats.bytes;
+    stats_total.plies += ctx->stats.plies;
+    stats_total.candidates += ctx->stats.candidates;
+    stats_total.emitted += ctx->stats.emitted;
+    stats_total.allocs += ctx->stats.allocs;
+}
+
+// only main finishes the report, bench has no --stats
+#ifndef PGN2PDF_NO_MAIN
+/*
+ * input: out - --stats report
+ *        seconds - wall time of the run
+ *        jobs - threads converting games
+ * output: totals printed, report finished
+ */
+static void
+stats_finish(FILE *out, double seconds, int jobs)
+{
+    fprintf(out, "\n],\n\"total\": {\"games\": %lu, ", stats_games);
+    print_stats(out, &stats_total);
+    fprintf(out, "},\n\"jobs\": %d,\n\"wall_seconds\": %.6f,\n"
+            "\"games_per_second\": %.1f,\n\"plies_per_second\": %.1f\n}\n",
+            jobs, seconds,
+            seconds > 0 ? stats_games / seconds : 0,
+            seconds > 0 ? stats_total.plies / seconds : 0);
+}
+#endif
+
+/*
+ * output: board_template, square_offset, square_macros, square_images
+ *         and pdf_board_template set up,
+ *         to be called once before boards are printed
+ */
+void
+init_board_template(void)
+{
+    static const char class_names[8] = "prnbqkkx";
+    int row, col;
+    int color, class, light;
+    char label[2] = { 0, 0 };
+    char *image;
+    char *to = board_template;
 
     for (row = 7; row >= 0; --row) {
-        fprintf(out, "\t \\LARGE{%d} ", row+1);
+        to += sprintf(to, "\\PGrank%c%d", row & 0x01 ? 'w' : 'b', row+1);
         for (col = 0; col < 8; ++col) {
-            place = POSITION(row,col);
-            class = board->square[place] & 0x07;
-            color = (board->square[place]>>7) & 0x01;
-            fig_name[0] = piece_color[color];
-            switch (class) {
-                case pawn: fig_name[1]='p';
-                           break;
-                case rook: fig_name[1]='r';
-                           break;
-                case knight: fig_name[1] = 'n';
-                             break;
-                case bishop: fig_name[1] = 'b';
-                             break;
-                case queen: fig_name[1] = 'q';
-                            break;
-                case king_moved:
-                case king: fig_name[1] = 'k';
-                           break;
-                case no_piece: fig_name[0] = fig_name[1] = 'x';
-                               break;
+            square_offset[POSITION(row,col)] = to - board_template;
+            *to++ = '-';
+        }
+        *to++ = '\n';
+    }
+    board_template_len = to - board_template;
+
+    to = square_macros;
+    for (color = white; color <= black; ++color) {
+        for (class = pawn; class <= no_piece; ++class) {
+            // king_moved looks like king, empty square has no color
+            if (class == king_moved || (class == no_piece && color == black))
+                continue;
+
+            for (light = 0; light < 2; ++light) {
+                image = square_images[(color << 3) | class][light];
+                image[0] = class == no_piece ? 'x' : color ? 'b' : 'w';
+                image[1] = class_names[class];
+                image[2] = light ? 'w' : 'b';
+                // empty square of black is the same as of white
+                if (class == no_piece)
+                    memcpy(square_images[(black << 3) | class][light], image, 4);
+                if (class == king)
+                    memcpy(square_images[(color << 3) | king_moved][light], image, 4);
+                image_names[image_names_nr++] = image;
+
+                // image is read and scaled once, squares only use its box
+                to += sprintf(to,
+                              "\\expandafter\\newsavebox\\csname PG%c%c\\endcsname\n"
+                              "\\expandafter\\sbox\\csname PG%c%c\\endcsname"
+                              "{\\includegraphics[width=2cm,height=2cm]{%s}}\n",
+                              square_letters[(color << 3) | class],
+                              light ? 'w' : 'b',
+                              square_letters[(color << 3) | class],
+                              light ? 'w' : 'b',
+                              image);
             }
+        }
+    }
+    square_macros_len = to - square_macros;
+
+    // file letters over and under the board, rank numbers at both sides
+    to = pdf_board_template;
+    to += sprintf(to, "BT /F1 %.2f Tf\n", PDF_LABEL_SIZE);
+    for (col = 0; col < 8; ++col) {
+        label[0] = 'a' + col;
+        to += sprintf(to, "1 0 0 1 %.2f %.2f Tm (%s) Tj\n",
+                      PDF_BOARD_X + (col + 0.5) * PDF_SQUARE -
+                          pdf_text_width(label, 1, PDF_LABEL_SIZE) / 2,
+                      PDF_BOARD_Y + 8 * PDF_SQUARE + 0.3 * PDF_LABEL_SIZE,
+                      label);
+        to += sprintf(to, "1 0 0 1 %.2f %.2f Tm (%s) Tj\n",
+                      PDF_BOARD_X + (col + 0.5) * PDF_SQUARE -
+                          pdf_text_width(label, 1, PDF_LABEL_SIZE) / 2,
+                      PDF_BOARD_Y - PDF_LABEL_SIZE,
+                      label);
+    }
+    for (row = 0; row < 8; ++row) {
+        label[0] = '1' + row;
+        to += sprintf(to, "1 0 0 1 %.2f %.2f Tm (%s) Tj\n",
+                      PDF_BOARD_X - 0.9 * PDF_LABEL_SIZE,
+                      PDF_BOARD_Y + (row + 0.5) * PDF_SQUARE - 0.35 * PDF_LABEL_SIZE,
+                      label);
+        to += sprintf(to, "1 0 0 1 %.2f %.2f Tm (%s) Tj\n",
+                      PDF_BOARD_X + 8 * PDF_SQUARE + 0.4 * PDF_LABEL_SIZE,
+                      PDF_BOARD_Y + (row + 0.5) * PDF_SQUARE - 0.35 * PDF_LABEL_SIZE,
+                      label);
+    }
+    to = stpcpy(to, "ET\n");
 
-            fig_name[2] = square_color[(row & 0x01) ^ (col & 0x01)];
-            fig_name[3] = '\0';
-
-            fprintf(out, "& \\includegraphics[width=2cm,height=2cm]{%s} ", fig_name);
+    for (row = 7; row >= 0; --row) {
+        for (col = 0; col < 8; ++col) {
+            to += sprintf(to, "q %.3f 0 0 %.3f %.3f %.3f cm /I",
+                          PDF_SQUARE, PDF_SQUARE,
+                          PDF_BOARD_X + col * PDF_SQUARE,
+                          PDF_BOARD_Y + row * PDF_SQUARE);
+            pdf_square_offset[POSITION(row,col)] = to - pdf_board_template;
+            to = stpcpy(to, "xxx Do Q\n");
         }
-        fprintf(out, " & \\LARGE{%d} & \\\\\n", row+1);
     }
+    pdf_board_template_len = to - pdf_board_template;
+}
+
+/*
+ * input: ctx - context with board to look up
+ *        move_nr, black - move the board is shown after
+ * output: return position shown before in the game with the same board,
+ *         NULL if it is shown first time (then it is remembered)
+ */
+static position_t *
+repeated_position(game_ctx_t *ctx, int move_nr, int black)
+{
+    const unsigned char *square = ctx->board.square;
+    uint64_t hash = ctx->board.hash;
+    position_t *position;
+    int i;
+
+    if (0 == ctx->positions_size) return NULL;
 
-    fprintf(out, board_finish_str);
+    for (i = hash & (ctx->positions_size - 1); ctx->positions[i].square;
+         i = (i + 1) & (ctx->positions_size - 1)) {
+        position = &ctx->positions[i];
+        if (position->hash == hash && 0 == memcmp(position->square, square, 64))
+            return position;
+    }
+
+    // table is sized for all positions of game, it is never full
+    position = &ctx->positions[i];
+    position->square = arena_alloc(&ctx->arena, 64);
+    if (NULL == position->square) return NULL;
+    memcpy(position->square, square, 64);
+    position->hash = hash;
+    position->box = 0;
+    position->move_nr = move_nr;
+    position->black = black;
+    return NULL;
 }
 
-reader_result_t
-check_finish (const char* token, FILE* out)
+/*
+ * input: ctx - context of game
+ *        opening - cached position of the board printed, NULL if not cached
+ *        diagram - board printed
+ *        len - size of diagram
+ * output: diagram kept in opening to be copied next time
+ */
+static void
+save_diagram(game_ctx_t *ctx, opening_t *opening, const char *diagram, int len)
 {
-           if (streq(token, "1-0")) {
-                return success;
-            }
+    if (NULL == opening) return;
 
-            if (streq(token, "0-1")) {
-                return success;
-            }
+    opening->diagram = arena_alloc(&ctx->openings->arena, len);
+    if (opening->diagram)
+        memcpy(opening->diagram, diagram, len);
+}
 
-            if (streq(token, "1/2-1/2")) {
-                return success;
-            }
+/*
+ * input: ctx - context with board to print
+ *        move_str - moves to show over the board (not null-terminated)
+ *        move_len - length of move_str
+ *        black - board after black move? (bit 0)
+ *        move_nr - number of the move
+ *        opening - cached position of the board, NULL if not cached
+ * output: pdf page content of the board appended to ctx->out,
+ *         its end added to ctx->page_ends
+ */
+static void
+print_board_pdf(game_ctx_t *ctx,
+                const char *move_str,
+                int move_len,
+                int black,
+                int move_nr,
+                opening_t *opening)
+{
+    char line[2 * 255 + 64];
+    char *to;
+    size_t *bigger;
+    unsigned char square;
+    double width;
+    int line_len;
+    int place;
+    position_t *position;
+    emitter_t *out = ctx->out;
+    board_t *board = &ctx->board;
+    const char *white_name, *black_name;
+    int white_len, black_len;
+
+    if (ctx->pages_nr == ctx->pages_size) {
+        bigger = realloc(ctx->page_ends, sizeof(size_t) * (ctx->pages_size * 2 + 64));
+        if (NULL == bigger) return;
+        ctx->page_ends = bigger;
+        ctx->pages_size = ctx->pages_size * 2 + 64;
+    }
 
-            if (streq(token, "*")) {
-                return success;
-            }
+    // players and moves centered over the board, as \PGtitle shows them
+    white_name = pgn_header_value(&ctx->header, pgn_tag_white, &white_len);
+    black_name = pgn_header_value(&ctx->header, pgn_tag_black, &black_len);
+    width = pdf_text_width(white_name, white_len, PDF_CAPTION_SIZE) +
+            pdf_text_width(black_name, black_len, PDF_CAPTION_SIZE) +
+            PDF_CAPTION_SIZE * (278 + 1000 + 278) / 1000;
+    line_len = snprintf(line, sizeof(line), "BT /F1 %.2f Tf 1 0 0 1 %.2f %.2f Tm ",
+                        PDF_CAPTION_SIZE, (PDF_PAGE_WIDTH - width) / 2, PDF_CAPTION_Y);
+    emitter_bytes(out, line, line_len);
+    pdf_text(out, white_name, white_len);
+    // em dash of "~---~"
+    emitter_str(out, " Tj ( \\227 ) Tj ");
+    pdf_text(out, black_name, black_len);
+    emitter_str(out, " Tj\n");
+
+    line_len = snprintf(line, sizeof(line), "%d. %.*s", move_nr, move_len, move_str);
+    width = pdf_text_width(line, line_len, PDF_CAPTION_SIZE);
+    to = emitter_reserve(out, 64);
+    if (NULL == to) return;
+    out->len -= 64 - sprintf(to, "1 0 0 1 %.2f %.2f Tm ", (PDF_PAGE_WIDTH - width) / 2,
+                             PDF_CAPTION_Y - 1.5 * PDF_CAPTION_SIZE);
+    pdf_text(out, line, line_len);
+    emitter_str(out, " Tj ET\n");
+
+    position = by_reference ? repeated_position(ctx, move_nr, black) : NULL;
+    if (position) {
+        line_len = snprintf(line, sizeof(line), "same as diagram of move %d%s",
+                            position->move_nr, position->black ? "..." : "");
+        width = pdf_text_width(line, line_len, PDF_CAPTION_SIZE);
+        to = emitter_reserve(out, 64);
+        if (NULL == to) return;
+        out->len -= 64 - sprintf(to, "BT /F1 %.2f Tf 1 0 0 1 %.2f %.2f Tm ",
+                                 PDF_CAPTION_SIZE, (PDF_PAGE_WIDTH - width) / 2,
+                                 PDF_CAPTION_Y - 4 * PDF_CAPTION_SIZE);
+        pdf_text(out, line, line_len);
+        emitter_str(out, " Tj ET\n");
+        ctx->page_ends[ctx->pages_nr++] = out->len;
+        return;
+    }
+
+    to = emitter_reserve(out, pdf_board_template_len);
+    if (NULL == to) return;
+    if (opening && opening->diagram) {
+        memcpy(to, opening->diagram, pdf_board_template_len);
+    } else {
+        memcpy(to, pdf_board_template, pdf_board_template_len);
+
+        for (place = 0; place < 64; ++place) {
+            square = board->square[place];
+            memcpy(to + pdf_square_offset[place],
+                   square_images[SQUARE_CODE(square)]
+                                [((place >> 3) ^ place) & 0x01], 3);
+        }
+        save_diagram(ctx, opening, to, pdf_board_template_len);
+    }
 
-            return failed;
+    ctx->page_ends[ctx->pages_nr++] = out->len;
 }
 
-reader_result_t
-read_moves(char *movetext_section,
-           FILE *out,
-           board_t *board)
+/*
+ * input: ctx - context with board to print
+ *        move_str - moves to show over the board (not null-terminated)
+ *        move_len - length of move_str
+ *        black - board after black move? (bit 0)
+ *        move_nr - number of the move
+ *        opening - cached position of the board, NULL if not cached
+ * output: LaTeX of the board appended to ctx->out
+ */
+void
+print_board(game_ctx_t *ctx,
+            const char *move_str,
+            int move_len,
+            int black,
+            int move_nr,
+            opening_t *opening)
 {
-    int move_nr;
-    move_t move;
-    char *move_white;
-    char *move_black;
-    char *token;
-    int result;
-    int is_black = 0;
-    char *move_to_print;
-    char *movetext_section2;
+    int place;
+    unsigned char square;
+    char *to;
+    int box = 0, saved = 0;
+    position_t *position;
+    emitter_t *out = ctx->out;
+    board_t *board = &ctx->board;
+
+    if (pdf_output) {
+        print_board_pdf(ctx, move_str, move_len, black, move_nr, opening);
+        return;
+    }
+
+    emitter_bytes(out, move_before_board_str, sizeof(move_before_board_str) - 1);
+
+    // \PGtitle shows \PGplayers set at the game start
+    emitter_str(out, "\\PGtitle{");
+    emitter_int(out, move_nr);
+    emitter_str(out, "}\\verb|");
+    emitter_bytes(out, move_str, move_len);
+    emitter_str(out, "| \\end{Large}\n");
+
+    position = repeated_position(ctx, move_nr, black);
+    if (position && by_reference) {
+        emitter_str(out, "\\centering\n\\PGsame{");
+        emitter_int(out, position->move_nr);
+        if (position->black)
+            emitter_str(out, "...");
+        emitter_str(out, "}\n");
+        return;
+    }
+
+    // position shown before is typeset once into savebox
+    if (position) {
+        saved = position->box != 0;
+        if (!position->box)
+            position->box = ++ctx->boxes_nr;
+        box = position->box;
+    }
+    if (box && saved) {
+        emitter_str(out, "\\centering\n\\PGuse{");
+        emitter_int(out, box);
+        emitter_str(out, "}\n");
+        return;
+    }
 
-    movetext_section2 = strdup(movetext_section);
-    // tokenize movetext_section
-    move_to_print = malloc(255+1);
-    token = strtok(movetext_section2, DELIMITERS);
-    while (token) {
-        move_nr = atoi(token);
+    if (box) {
+        emitter_str(out, "\\centering\n\\PGsave{");
+        emitter_int(out, box);
+        emitter_str(out, "}{\\PGboard{%\n");
+    } else {
+        emitter_bytes(out, board_start_str, sizeof(board_start_str) - 1);
+    }
 
-        if (0 == move_nr) break;
+    to = emitter_reserve(out, board_template_len);
+    if (NULL == to) return;
+    if (opening && opening->diagram) {
+        memcpy(to, opening->diagram, board_template_len);
+    } else {
+        memcpy(to, board_template, board_template_len);
 
-        token = strtok(NULL, DELIMITERS);
-        if (NULL == token) break;
-        move_white = strdup(token);
+        for (place = 0; place < 64; ++place) {
+            square = board->square[place];
+            to[square_offset[place]] = square_letters[SQUARE_CODE(square)];
+        }
+        save_diagram(ctx, opening, to, board_template_len);
+    }
 
-        token = strtok(NULL, DELIMITERS);
-        if (NULL == token) move_black = strdup("");
-        move_black = strdup(token);
+    if (box)
+        emitter_str(out, "}}\n");
+    else
+        emitter_bytes(out, board_finish_str, sizeof(board_finish_str) - 1);
+}
 
-        sprintf(move_to_print, "%s %s", move_white, move_black);
-        /*printf("Parsing %d. %s\n", move_nr, move_to_print);*/
+/*
+ * input: san - move of game tree
+ *        board - board to make move on
+ *        move - move structure
+ *        black - moving as blacks? (bit 0)
+ * output: return result - 0 - ok, != 0 - fail
+ *         board - board after the move
+ */
+static int
+parse_san(const pgn_move_t *san,
+          board_t *board,
+          move_t *move,
+          char black)
+{
+    // parse_move cuts the string, so it gets a copy
+    char move_str[SAN_MAX + 1];
 
-        if (check_finish(move_white, out) == success) break;
-        is_black = 0;
-        result = parse_move(move_white,
-                            board->real_whites,
-                            board->real_blacks,
-                            &move,is_black);
+    if (san->san_len > SAN_MAX) return -1;
+    memcpy(move_str, san->san, san->san_len);
+    move_str[san->san_len] = '\0';
 
-        convert_board(board);
-        print_board(out, board, move_to_print, is_black, move_nr);
+    return parse_move(move_str, board, move, black);
+}
 
-        if (check_finish(move_black, out) == success) break;
-        is_black = 1;
-        result = parse_move(move_black,
-                            board->real_blacks,
-                            board->real_whites,
-                            &move,is_black);
+/*
+ * input: ctx - context with board after opening
+ *        opening - cached position of the board, NULL when the game
+ *                  left cached beginnings
+ *        san - move to make
+ *        black - moving as blacks? (bit 0)
+ * output: return cached position after the move, NULL if it is not cached
+ *         ctx->board - board after the move, taken from cache when
+ *                      the move was made from this position before
+ */
+static opening_t *
+replay_move(game_ctx_t *ctx, opening_t *opening, const pgn_move_t *san, char black)
+{
+    opening_cache_t *cache = ctx->openings;
+    board_t *board = &ctx->board;
+    opening_t *next;
+    move_t parsed;
+    int result;
 
-        convert_board(board);
-        print_board(out, board, move_to_print, black, move_nr);
+    if (opening) {
+        for (next = opening->children; next; next = next->next) {
+            if (next->san_len != san->san_len ||
+                memcmp(next->san, san->san, san->san_len))
+                continue;
 
-        free(move_white);
-        free(move_black);
+            *board = next->board;
+            board->real_whites = &board->whites[1];
+            board->real_blacks = &board->blacks[1];
+            return next;
+        }
+    }
+
+    parsed.candidates = 0;
+    result = parse_san(san, board, &parsed, black);
+    ctx->stats.candidates += parsed.candidates;
+    if (result != 0 || NULL == opening ||
+        opening->ply == OPENING_PLIES || cache->nodes_nr == OPENING_NODES)
+        return NULL;
+
+    next = arena_alloc(&cache->arena, sizeof(opening_t));
+    if (NULL == next) return NULL;
+    memcpy(next->san, san->san, san->san_len);
+    next->san_len = san->san_len;
+    next->ply = opening->ply + 1;
+    next->board = *board;
+    next->diagram = NULL;
+    next->children = NULL;
+    next->next = opening->children;
+    opening->children = next;
+    ++cache->nodes_nr;
+    return next;
+}
+
+/*
+ * input: ctx - context with board set up
+ *        movetext_section - movetext (not null-terminated)
+ *        len - size of movetext_section
+ * output: return success/failed (out of memory)
+ *         ctx->tree - the game tree
+ *         LaTeX of board after every move of mainline written to ctx->out
+ */
+reader_result_t
+read_moves(game_ctx_t *ctx,
+           const char *movetext_section,
+           int len)
+{
+    pgn_move_t *move, *move_white, *move_black;
+    opening_t *opening;
+    char move_to_print[2 * 255 + 2];
+    char *to;
+    double start, replayed, printed;
+    opening_cache_t *cache = ctx->openings;
+
+    start = stats_clock();
+    if (pgn_tree_parse(&ctx->tree, &ctx->arena,
+                       movetext_section, len) == failed)
+        return failed;
+    ctx->stats.seconds[stage_tree] += stats_clock() - start;
+
+    // room for every position of mainline at half load
+    for (ctx->positions_size = 16;
+         ctx->positions_size < 2 * ctx->tree.moves_nr;
+         ctx->positions_size *= 2);
+    ctx->positions = arena_alloc(&ctx->arena,
+                                 sizeof(position_t) * ctx->positions_size);
+    if (NULL == ctx->positions)
+        return failed;
+    memset(ctx->positions, 0, sizeof(position_t) * ctx->positions_size);
+    ctx->boxes_nr = 0;
+
+    // start over when cache is full, the game is the only one using it
+    if (cache->nodes_nr == OPENING_NODES) {
+        arena_reset(&cache->arena);
+        cache->root = NULL;
+        cache->nodes_nr = 0;
+    }
+    if (NULL == cache->root) {
+        cache->root = arena_alloc(&cache->arena, sizeof(opening_t));
+        if (NULL == cache->root) return failed;
+        memset(cache->root, 0, sizeof(opening_t));
+        cache->nodes_nr = 1;
+    }
+    opening = cache->root;
+
+    move = ctx->tree.mainline;
+    while (move) {
+        // both moves of a number are shown with each board
+        move_white = move->black ? NULL : move;
+        move_black = move_white ? move->next : move;
+        if (move_black && !move_black->black) move_black = NULL;
+        move = (move_black ? move_black : move_white)->next;
+
+        to = move_to_print;
+        if (move_white) {
+            memcpy(to, move_white->san, move_white->shown_len);
+            to += move_white->shown_len;
+        } else {
+            to = stpcpy(to, "...");
+        }
+        *to++ = ' ';
+        if (move_black) {
+            memcpy(to, move_black->san, move_black->shown_len);
+            to += move_black->shown_len;
+        } else if (NULL == move) {
+            memcpy(to, ctx->tree.result, ctx->tree.result_len);
+            to += ctx->tree.result_len;
+        }
+
+        if (move_white) {
+            start = stats_clock();
+            opening = replay_move(ctx, opening, move_white, white);
+            replayed = stats_clock();
+            print_board(ctx, move_to_print, to - move_to_print,
+                        white, move_white->move_nr, opening);
+            printed = stats_clock();
+            ctx->stats.seconds[stage_replay] += replayed - start;
+            ctx->stats.seconds[stage_print] += printed - replayed;
+            ++ctx->stats.plies;
+        }
 
-        token = strtok(NULL,DELIMITERS);
+        if (move_black) {
+            start = stats_clock();
+            opening = replay_move(ctx, opening, move_black, black);
+            replayed = stats_clock();
+            print_board(ctx, move_to_print, to - move_to_print,
+                        black, move_black->move_nr, opening);
+            printed = stats_clock();
+            ctx->stats.seconds[stage_replay] += replayed - start;
+            ctx->stats.seconds[stage_print] += printed - replayed;
+            ++ctx->stats.plies;
+        }
     }
 
-    free(move_to_print);
-    free(movetext_section2);
     return success;
 }
 
 board_t *
-make_new_board(FILE *out,
-               board_t *board)
+make_new_board(board_t *board)
 {
     /* place black pieces */
     SET_PIECE_PLACE_CLASS(board->real_blacks[pawn1_idx],POSITION(6,0),pawn);
@@ -1321,81 +1636,836 @@ make_new_board(FILE *out,
     SET_PIECE_PLACE_CLASS(board->real_whites[queen_idx],POSITION(0,3),queen);
     SET_PIECE_PLACE_CLASS(board->real_whites[king_idx],POSITION(0,4),king);
 
-    fprintf(out,"\\clearpage\n");
+    sync_squares(board);
 
     return board;
 }
 
 void
-start_boards(FILE *out)
+start_boards(emitter_t *out)
 {
-    fprintf(out, pre_boards_str);
+    emitter_bytes(out, pre_boards_str, sizeof(pre_boards_str) - 1);
+    emitter_bytes(out, square_macros, square_macros_len);
+    if (by_reference)
+        emitter_bytes(out, same_board_str, sizeof(same_board_str) - 1);
+    emitter_str(out, "\n");
 }
 
 void
-finish_boards(FILE *out)
+finish_boards(emitter_t *out)
 {
-    fprintf(out, post_boards_str);
+    emitter_bytes(out, post_boards_str, sizeof(post_boards_str) - 1);
 }
 
-/* main function */
+/*
+ * input: doc - document to set up
+ *        name - file name of document
+ * output: return 0 - ok, -1 - fail (reported)
+ *         doc - emitter writing to the document,
+ *               preamble or pdf resources emitted
+ */
 int
-main (int argc, char **argv)
+open_doc(doc_t *doc, const char *name)
 {
-    FILE *in;
-    FILE *out;
-    int game_start;
-    move_t move_white, move_black;
-    board_t *board;
-    struct stat st;
-    char *file_data;
-
-    if (argc != 3) {
-        printf("usage: %s <input.pgn> <output.tex>\n", argv[0]);
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        fprintf(stderr, "open failed for '%s': %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    emitter_init(&doc->out, fd);
+    if (!pdf_output) {
+        start_boards(&doc->out);
         return 0;
     }
 
-    if (stat(argv[1], &st) < 0) {
-        perror("cant stat input file");
-        return 1;
+    if (pdf_open(&doc->pdf, &doc->out, pics_dir, image_names, image_names_nr) < 0) {
+        pdf_free(&doc->pdf);
+        emitter_free(&doc->out);
+        close(fd);
+        unlink(name);
+        return -1;
     }
+    return 0;
+}
+
+/*
+ * input: doc - emitter opened with open_doc
+ *        name - file name of document
+ * output: return 0 - ok, -1 - fail (reported)
+ *         document finished, written and closed
+ */
+int
+close_doc(doc_t *doc, const char *name)
+{
+    int res = 0;
 
-    in = fopen(argv[1], "r");
-    out = fopen(argv[2], "w");
+    if (!pdf_output) {
+        finish_boards(&doc->out);
+    } else {
+        if (pdf_close(&doc->pdf) < 0)
+            doc->out.error = ENOMEM;
+        pdf_free(&doc->pdf);
+    }
 
-    if (NULL == in || NULL == out) {
-        perror("fopen");
-        return 1;
+    if (emitter_flush(&doc->out) < 0) {
+        fprintf(stderr, "write failed for '%s': %s\n", name, strerror(doc->out.error));
+        res = -1;
     }
+    if (close(doc->out.fd) < 0 && 0 == res) {
+        fprintf(stderr, "close failed for '%s': %s\n", name, strerror(errno));
+        res = -1;
+    }
+    emitter_free(&doc->out);
+
+    return res;
+}
+
+/*
+ * input: to - where to store the name of per-game document
+ *        base - output name as given in command line
+ *        k - game number (0-based)
+ * output: to - "<base>-<k>.tex" with ".tex" suffix of base dropped
+ *         (".pdf" when writing pdf)
+ */
+void
+game_doc_name(char *to, const char *base, int k)
+{
+    const char *suffix = pdf_output ? ".pdf" : ".tex";
+    int base_len = strlen(base);
+
+    if (base_len > 4 && streq(base + base_len - 4, suffix))
+        base_len -= 4;
+
+    sprintf(to, "%.*s-%d%s", base_len, base, k, suffix);
+}
+
+void
+init_opening_cache(opening_cache_t *cache)
+{
+    arena_init(&cache->arena);
+    cache->root = NULL;
+    cache->nodes_nr = 0;
+}
 
-    rewind(in);
-    file_data = malloc(st.st_size+1);
-    fread(file_data, 1, st.st_size, in);
-    file_data[st.st_size] = '\0';
-    fclose(in);
+void
+free_opening_cache(opening_cache_t *cache)
+{
+    arena_free(&cache->arena);
+}
+
+void
+init_game_ctx(game_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->board.real_whites = &ctx->board.whites[1];
+    ctx->board.real_blacks = &ctx->board.blacks[1];
+    arena_init(&ctx->arena);
+    emitter_init(&ctx->game_out, -1);
+}
+
+void
+free_game_ctx(game_ctx_t *ctx)
+{
+    free(ctx->game);
+    emitter_free(&ctx->game_out);
+    free(ctx->page_ends);
+    arena_free(&ctx->arena);
+}
 
-    board = malloc(sizeof(board_t));
-    board->real_whites = &board->whites[1];
-    board->real_blacks = &board->blacks[1];
+/*
+ * input: ctx - context
+ *        game - game data (not null-terminated)
+ *        game_len - size of game
+ * output: ctx->failed_ply, ctx->failed_move - where mainline of the game
+ *         fails to replay, nothing is printed
+ */
+static void
+verify_game(game_ctx_t *ctx, char *game, int game_len)
+{
+    pgn_move_t *move;
+    move_t parsed;
+    size_t moves_start;
+    int ply;
+    double start = stats_clock();
+
+    ctx->failed_ply = 0;
+    ctx->failed_move = NULL;
+    pgn_header_parse(&ctx->header, game, game_len);
+    moves_start = ctx->header.movetext;
+    ctx->stats.seconds[stage_header] += stats_clock() - start;
+
+    start = stats_clock();
+    arena_reset(&ctx->arena);
+    if (pgn_tree_parse(&ctx->tree, &ctx->arena, game + moves_start,
+                       game_len - moves_start) == failed) {
+        ctx->failed_ply = -1;
+        return;
+    }
+    ctx->stats.seconds[stage_tree] += stats_clock() - start;
+
+    start = stats_clock();
+    make_new_board(&ctx->board);
+    for (move = ctx->tree.mainline, ply = 1; move; move = move->next, ++ply) {
+        parsed.candidates = 0;
+        if (parse_san(move, &ctx->board, &parsed, move->black) != 0) {
+            ctx->failed_ply = ply;
+            ctx->failed_move = move;
+            break;
+        }
+        ctx->stats.candidates += parsed.candidates;
+        ++ctx->stats.plies;
+    }
+    ctx->stats.seconds[stage_replay] += stats_clock() - start;
+}
 
-    start_boards(out);
+/*
+ * input: ctx - context with the game verified
+ * output: failure of the game reported to stdout
+ */
+static void
+report_game(const game_ctx_t *ctx)
+{
+    const pgn_move_t *move = ctx->failed_move;
+
+    ++verify_games;
+    if (0 == ctx->failed_ply) return;
+
+    ++verify_failed;
+    if (ctx->failed_ply < 0)
+        printf("game %d: out of memory reading moves\n", ctx->k);
+    else
+        printf("game %d ply %d: cannot make move %d%s %.*s\n", ctx->k,
+               ctx->failed_ply, move->move_nr, move->black ? "..." : ".",
+               move->san_len, move->san);
+}
 
-    game_start = 0;
-    /*while (find_next_game(file_data, &game_start, st.st_size) == success) {*/
-    find_next_game(file_data, &game_start, st.st_size);
-    read_white_black(file_data, game_start, st.st_size);
+/*
+ * input: ctx - context
+ *        game - game data (not null-terminated)
+ *        game_len - size of game
+ * output: LaTeX (pdf pages) of the game in ctx->game_out
+ */
+void
+convert_game(game_ctx_t *ctx, char *game, int game_len)
+{
+    size_t moves_start;
+    const char *name;
+    int name_len;
+    double start;
+    unsigned long allocs = ctx->arena.allocs + ctx->game_out.allocs +
+                           ctx->openings->arena.allocs;
+
+    ctx->out = &ctx->game_out;
+    ctx->game_out.len = 0;
+    ctx->pages_nr = 0;
+    ctx->stats.bytes += game_len;
+
+    if (verify_only) {
+        verify_game(ctx, game, game_len);
+        return;
+    }
 
-    make_new_board(out, board);
+    start = stats_clock();
+    pgn_header_parse(&ctx->header, game, game_len);
+    moves_start = ctx->header.movetext;
+    ctx->stats.seconds[stage_header] += stats_clock() - start;
+
+    if (games_dir) {
+        char doc_name[PATH_MAX];
+        char key_name[PATH_MAX];
+
+        ctx->result = pgn_header_result(&ctx->header);
+        sprintf(ctx->key, "%016llx %d%s\n",
+                (unsigned long long)pgn_hash64(game, game_len), TEMPLATE_VERSION,
+                by_reference ? " R" : "");
+        pgn_game_name(doc_name, games_dir, ctx->k, ctx->result,
+                      pdf_output ? ".pdf" : ".tex");
+        pgn_game_name(key_name, games_dir, ctx->k, ctx->result, ".key");
+        // document of the same game by the same template is kept
+        ctx->up_to_date = pgn_same_key(key_name, ctx->key) &&
+                          access(doc_name, F_OK) == 0;
+        if (ctx->up_to_date)
+            return;
+    }
 
-    goto_moves(file_data, &game_start, st.st_size);
+    make_new_board(&ctx->board);
+
+    if (!pdf_output) {
+        emitter_str(ctx->out, "\\clearpage\n");
+        emitter_str(ctx->out, "\\renewcommand{\\PGplayers}{");
+        name = pgn_header_value(&ctx->header, pgn_tag_white, &name_len);
+        emitter_bytes(ctx->out, name, name_len);
+        emitter_str(ctx->out, "~---~");
+        name = pgn_header_value(&ctx->header, pgn_tag_black, &name_len);
+        emitter_bytes(ctx->out, name, name_len);
+        emitter_str(ctx->out, "}\n");
+    }
 
-    read_moves(file_data + game_start, out, board);
-    /*}*/
+    // tree of previous game is not needed any more
+    arena_reset(&ctx->arena);
+    if (read_moves(ctx, game + moves_start, game_len - moves_start) == failed)
+        fprintf(stderr, "Out of memory reading moves of game %d\n", ctx->k);
 
-    finish_boards(out);
-    fclose(out);
+    ctx->stats.emitted += ctx->game_out.len;
+    ctx->stats.allocs += ctx->arena.allocs + ctx->game_out.allocs +
+                         ctx->openings->arena.allocs - allocs;
+}
 
-    free(board);
+/*
+ * input: ctx - context with the game written to games_dir
+ * output: return 0 - ok, -1 - fail (reported)
+ *         <game>.key next to the document, to keep it in later runs
+ */
+static int
+write_game_key(game_ctx_t *ctx)
+{
+    char key_name[PATH_MAX];
+    FILE *out;
 
+    pgn_game_name(key_name, games_dir, ctx->k, ctx->result, ".key");
+    out = fopen(key_name, "w");
+    if (!out) {
+        fprintf(stderr, "fopen failed for '%s': %s\n", key_name, strerror(errno));
+        return -1;
+    }
+    fputs(ctx->key, out);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "write failed for '%s': %s\n", key_name, strerror(errno));
+        return -1;
+    }
     return 0;
 }
+
+/*
+ * input: ctx - context with the game converted
+ *        out - combined document, or NULL to write ctx->game_out
+ *              to document of its own
+ *        out_base - output name as given in command line
+ * output: return 0 - ok, != 0 - fail
+ */
+int
+write_game(game_ctx_t *ctx, doc_t *out, const char *out_base)
+{
+    char out_name[PATH_MAX];
+    doc_t doc;
+    doc_t *to = out ? out : &doc;
+    size_t start = 0;
+    double started = stats_clock();
+    int res = 0;
+    int i;
+
+    if (verify_only) {
+        report_game(ctx);
+        if (stats_file)
+            stats_game(stats_file, ctx);
+        return 0;
+    }
+
+    if (NULL == out) {
+        if (games_dir && ctx->up_to_date) {
+            if (stats_file)
+                stats_game(stats_file, ctx);
+            return 0;
+        }
+
+        if (games_dir)
+            pgn_game_name(out_name, games_dir, ctx->k, ctx->result,
+                          pdf_output ? ".pdf" : ".tex");
+        else
+            game_doc_name(out_name, out_base, ctx->k);
+        if (open_doc(&doc, out_name) < 0)
+            return -1;
+    }
+
+    if (!pdf_output) {
+        emitter_bytes(&to->out, ctx->game_out.buf, ctx->game_out.len);
+    } else {
+        for (i = 0; i < ctx->pages_nr; ++i) {
+            if (pdf_page(&to->pdf, ctx->game_out.buf + start,
+                         ctx->page_ends[i] - start) < 0) {
+                fprintf(stderr, "out of memory writing pdf\n");
+                res = -1;
+                break;
+            }
+            start = ctx->page_ends[i];
+        }
+    }
+
+    if (NULL == out && close_doc(&doc, out_name) < 0)
+        res = -1;
+    if (NULL == out && games_dir && 0 == res)
+        res = write_game_key(ctx);
+
+    if (stats_file) {
+        ctx->stats.seconds[stage_write] += stats_clock() - started;
+        stats_game(stats_file, ctx);
+    }
+    return res;
+}
+
+// where games to convert come from
+typedef struct {
+    pgn_reader_t *reader;
+    // index of mapped input when games are selected by query
+    pgn_index_t *index;
+    uint32_t *selected;
+    uint32_t selected_nr;
+    // games given so far
+    int given;
+    // range of game numbers to give, end excluded
+    int start;
+    int end;
+} game_source_t;
+
+/*
+ * input: source - games to convert
+ * output: return success - game found, failed - no more games
+ *         game, len - game data as given by reader
+ *         k - game number in input (0-based)
+ */
+reader_result_t
+next_game(game_source_t *source, char **game, int *len, int *k)
+{
+    pgn_index_entry_t *entry;
+
+    if (NULL == source->index) {
+        do {
+            if (source->given >= source->end ||
+                pgn_reader_next_game(source->reader, game, len) == failed)
+                return failed;
+            *k = source->given++;
+        } while (*k < source->start);
+        return success;
+    }
+
+    // selected games are in input order
+    while (source->given < source->selected_nr &&
+           (int)source->selected[source->given] < source->start)
+        ++source->given;
+    if (source->given == source->selected_nr ||
+        (int)source->selected[source->given] >= source->end)
+        return failed;
+
+    *k = source->selected[source->given++];
+    entry = &source->index->games[*k];
+    *game = source->reader->data + entry->offset;
+    *len = entry->length;
+    return success;
+}
+
+// games converted in parallel, written in input order
+typedef struct {
+    // slot of game k is slots[k % slots_nr]
+    game_ctx_t *slots;
+    // is slot converted?
+    char *done;
+    int slots_nr;
+    // games handed to pool
+    int filled;
+    // games taken by workers
+    int taken;
+    // no more games to hand
+    int finished;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t converted;
+} pool_t;
+
+void *
+pool_worker(void *arg)
+{
+    pool_t *pool = arg;
+    game_ctx_t *ctx;
+    opening_cache_t openings;
+    int k;
+
+    init_opening_cache(&openings);
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->taken == pool->filled && !pool->finished)
+            pthread_cond_wait(&pool->work, &pool->lock);
+
+        if (pool->taken == pool->filled) {
+            pthread_mutex_unlock(&pool->lock);
+            free_opening_cache(&openings);
+            return NULL;
+        }
+
+        k = pool->taken++;
+        pthread_mutex_unlock(&pool->lock);
+
+        ctx = &pool->slots[k % pool->slots_nr];
+        ctx->openings = &openings;
+        convert_game(ctx, ctx->game, ctx->game_len);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->done[k % pool->slots_nr] = 1;
+        pthread_cond_signal(&pool->converted);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*
+ * input: source - games to convert
+ *        out - combined document, or NULL for document per game
+ *        out_base - output name as given in command line
+ *        jobs - number of worker threads
+ * output: return 0 - ok, != 0 - fail
+ */
+int
+convert_parallel(game_source_t *source, doc_t *out,
+                 const char *out_base, int jobs)
+{
+    pool_t pool;
+    pthread_t *workers;
+    game_ctx_t *ctx;
+    char *game;
+    int game_len;
+    int k;
+    int fill, written;
+    double started;
+    int have_games = 1;
+    int res = 0;
+    int i;
+
+    memset(&pool, 0, sizeof(pool));
+    // keep workers busy while the head game is being waited for
+    pool.slots_nr = jobs * 4;
+    pool.slots = malloc(sizeof(game_ctx_t) * pool.slots_nr);
+    pool.done = calloc(pool.slots_nr, 1);
+    for (i = 0; i < pool.slots_nr; ++i)
+        init_game_ctx(&pool.slots[i]);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.converted, NULL);
+
+    workers = malloc(sizeof(pthread_t) * jobs);
+    for (i = 0; i < jobs; ++i)
+        pthread_create(&workers[i], NULL, pool_worker, &pool);
+
+    fill = written = 0;
+    for (;;) {
+        // slots from written to fill are owned by workers,
+        // the rest are free to be filled without lock
+        while (have_games && fill - written < pool.slots_nr) {
+            started = stats_clock();
+            if (next_game(source, &game, &game_len, &k) == failed) {
+                have_games = 0;
+                break;
+            }
+
+            ctx = &pool.slots[fill % pool.slots_nr];
+            memset(&ctx->stats, 0, sizeof(ctx->stats));
+            ctx->stats.seconds[stage_scan] = stats_clock() - started;
+            if (ctx->game_size < game_len) {
+                ctx->game = realloc(ctx->game, game_len);
+                ctx->game_size = game_len;
+            }
+            memcpy(ctx->game, game, game_len);
+            ctx->game_len = game_len;
+            ctx->k = k;
+            ++fill;
+
+            pthread_mutex_lock(&pool.lock);
+            pool.filled = fill;
+            pthread_cond_signal(&pool.work);
+            pthread_mutex_unlock(&pool.lock);
+        }
+
+        if (written == fill)
+            break;
+
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.done[written % pool.slots_nr])
+            pthread_cond_wait(&pool.converted, &pool.lock);
+        pool.done[written % pool.slots_nr] = 0;
+        pthread_mutex_unlock(&pool.lock);
+
+        ctx = &pool.slots[written % pool.slots_nr];
+        if (0 == res)
+            res = write_game(ctx, out, out_base);
+        ++written;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.finished = 1;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < jobs; ++i)
+        pthread_join(workers[i], NULL);
+
+    for (i = 0; i < pool.slots_nr; ++i)
+        free_game_ctx(&pool.slots[i]);
+    pthread_cond_destroy(&pool.converted);
+    pthread_cond_destroy(&pool.work);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.done);
+    free(pool.slots);
+    free(workers);
+
+    return res;
+}
+
+// bench/bench.c includes this file without main
+#ifndef PGN2PDF_NO_MAIN
+// long options without short ones
+enum long_option_t {
+    option_stats = 256,
+    option_verify
+};
+
+// exit status of pgn2pdf.bin
+enum exit_status_t {
+    exit_ok = 0,
+    // with --verify: some games do not replay
+    exit_bad_games = 1,
+    // input cannot be read, output written, or options are wrong
+    exit_error = 2
+};
+
+/* main function */
+int
+main (int argc, char **argv)
+{
+    doc_t doc;
+    doc_t *out;
+    pgn_reader_t reader;
+    pgn_index_t index;
+    pgn_query_t query;
+    game_source_t source;
+    char *game;
+    int game_len;
+    game_ctx_t ctx;
+    opening_cache_t openings;
+    char pics_path[PATH_MAX];
+    const char *slash;
+    int out_len;
+    const char *out_name;
+    char **range;
+    int args_nr;
+    int multiple = 0;
+    int jobs = 1;
+    int res = 0;
+    int opt;
+    double started, run_started;
+    static const struct option long_options[] = {
+        { "stats", optional_argument, NULL, option_stats },
+        { "verify", no_argument, NULL, option_verify },
+        { NULL, 0, NULL, 0 }
+    };
+
+    bb_init();
+    init_zobrist();
+    init_board_template();
+
+    pgn_query_init(&query);
+    while ((opt = getopt_long(argc, argv, "mD:Rj:i:V" PGN_QUERY_OPTIONS,
+                              long_options, NULL)) != -1) {
+        switch (opt) {
+            case option_verify:
+                verify_only = 1;
+                break;
+            case option_stats:
+                if (NULL == optarg)
+                    stats_file = stderr;
+                else if (streq(optarg, "-"))
+                    stats_file = stdout;
+                else if (NULL == (stats_file = fopen(optarg, "w"))) {
+                    fprintf(stderr, "fopen failed for '%s': %s\n", optarg, strerror(errno));
+                    return exit_error;
+                }
+                break;
+            case 'V':
+                printf("%d\n", TEMPLATE_VERSION);
+                return exit_ok;
+            case 'm':
+                multiple = 1;
+                break;
+            case 'R':
+                by_reference = 1;
+                break;
+            case 'D':
+                if (!streq(optarg, "tex") && !streq(optarg, "pdf")) {
+                    fprintf(stderr, "-D takes tex or pdf, not '%s'\n", optarg);
+                    return exit_error;
+                }
+                pdf_output = streq(optarg, "pdf");
+                multiple = 1;
+                // directory is the output argument
+                games_dir = "";
+                break;
+            case 'i':
+                pics_dir = optarg;
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                if (jobs < 1) jobs = 1;
+                break;
+            default:
+                if (pgn_query_option(&query, opt, optarg) != 1)
+                    return exit_error;
+                break;
+        }
+    }
+
+    // --verify takes no output
+    out_name = verify_only ? NULL : argv[optind + 1];
+    args_nr = argc - optind - !verify_only;
+    if (args_nr < 1 || args_nr > 3) {
+        printf("usage: %s [-m] [-D tex|pdf] [-R] [-j N] [-i pics] [query]\n"
+               "          <input.pgn> <output.tex|output.pdf> [start_num] [end_num]\n"
+               "usage: or %s --verify [-j N] [query] <input.pgn> [start_num] [end_num]\n"
+               "  <input.pgn> may be '-' to read from stdin\n"
+               "  <output.pdf> - write pdf right away instead of LaTeX\n"
+               "  start_num, end_num - 0-based range of games,\n"
+               "       a single number is end_num with start_num = 0\n"
+               "  -m - write every game to its own <output>-<N>.tex\n"
+               "       instead of one document with all the games\n"
+               "  -D tex|pdf - <output> is a directory, write every game to\n"
+               "       <output>/game-<N>[-ww|-bw|-00].tex (.pdf) named as by pgn2dir,\n"
+               "       games converted before by the same template are kept\n"
+               "  -R - print position repeated in game as reference to its\n"
+               "       first diagram instead of the board\n"
+               "  -j N - convert N games at a time\n"
+               "  -i pics - directory of square images for pdf,\n"
+               "            pics next to <output.pdf> by default\n"
+               "  -V - print version of output template and exit\n"
+               "  --stats[=file] - write JSON of time and counters of every stage\n"
+               "       for every game and in total to file ('-' for stdout, stderr\n"
+               "       without file)\n"
+               "  --verify - only replay mainlines of games, print games failing with\n"
+               "       move that cannot be made\n"
+               "query - only games matching all of (uses <input.pgn>idx index):\n"
+               PGN_QUERY_USAGE
+               "exit status: 0 - ok, 1 - some games do not replay (--verify),\n"
+               "  2 - input cannot be read, output written or options are wrong\n",
+               argv[0], argv[0]);
+        return exit_ok;
+    }
+
+    memset(&source, 0, sizeof(source));
+    source.end = INT_MAX;
+    range = argv + argc - (args_nr - 1);
+    if (args_nr == 2)
+        source.end = atoi(range[0]) + 1;
+    if (args_nr == 3) {
+        source.start = atoi(range[0]);
+        source.end = atoi(range[1]) + 1;
+    }
+
+    if (verify_only) {
+        // nothing is printed, games are only handed to write_game in order
+        multiple = 1;
+        games_dir = NULL;
+        pdf_output = 0;
+    } else if (games_dir) {
+        games_dir = out_name;
+        if (mkdir(games_dir, 0755) < 0 && errno != EEXIST) {
+            fprintf(stderr, "mkdir failed for '%s': %s\n", games_dir, strerror(errno));
+            return exit_error;
+        }
+        if (pdf_output && NULL == pics_dir) {
+            snprintf(pics_path, sizeof(pics_path), "%s/pics", games_dir);
+            pics_dir = pics_path;
+        }
+    }
+
+    out_len = out_name ? strlen(out_name) : 0;
+    if (!games_dir && out_name)
+        pdf_output = out_len > 4 && streq(out_name + out_len - 4, ".pdf");
+    if (pdf_output && NULL == pics_dir) {
+        // as \graphicspath of LaTeX run in directory of document
+        slash = strrchr(out_name, '/');
+        snprintf(pics_path, sizeof(pics_path), "%.*spics",
+                 slash ? (int)(slash - out_name + 1) : 0, out_name);
+        pics_dir = pics_path;
+    }
+
+    if (pgn_reader_open(&reader, argv[optind]) == failed) {
+        perror("cant open input file");
+        return exit_error;
+    }
+
+    source.reader = &reader;
+    // index jumps straight to start_num of regular file, query needs it
+    if ((!pgn_query_empty(&query) || source.start > 0) &&
+        pgn_index_open(&index, argv[optind], &reader) == success) {
+        if (pgn_index_select(&index, &query,
+                             &source.selected, &source.selected_nr) == failed) {
+            perror("cant select games");
+            pgn_index_free(&index);
+            pgn_reader_close(&reader);
+            return exit_error;
+        }
+        source.index = &index;
+    } else if (!pgn_query_empty(&query)) {
+        fprintf(stderr, "query needs <input.pgn> to be a regular file\n");
+        pgn_reader_close(&reader);
+        return exit_error;
+    }
+
+    run_started = stats_clock();
+    if (stats_file)
+        fprintf(stats_file, "{\n\"games\": [\n");
+
+    out = NULL;
+    if (!multiple) {
+        if (open_doc(&doc, out_name) < 0) {
+            res = -1;
+            goto done;
+        }
+        out = &doc;
+    }
+
+    if (jobs > 1) {
+        res = convert_parallel(&source, out, out_name, jobs);
+    } else {
+        init_game_ctx(&ctx);
+        init_opening_cache(&openings);
+        ctx.openings = &openings;
+        for (;;) {
+            started = stats_clock();
+            if (next_game(&source, &game, &game_len, &ctx.k) == failed)
+                break;
+            memset(&ctx.stats, 0, sizeof(ctx.stats));
+            ctx.stats.seconds[stage_scan] = stats_clock() - started;
+
+            convert_game(&ctx, game, game_len);
+
+            if (write_game(&ctx, out, out_name) < 0) {
+                res = -1;
+                break;
+            }
+        }
+        free_game_ctx(&ctx);
+        free_opening_cache(&openings);
+    }
+
+    if (!multiple && close_doc(&doc, out_name) < 0)
+        res = -1;
+
+    if (verify_only)
+        fprintf(stderr, "%lu of %lu games replay\n",
+                verify_games - verify_failed, verify_games);
+
+    if (stats_file) {
+        stats_finish(stats_file, stats_clock() - run_started, jobs);
+        if (stats_file != stderr && stats_file != stdout)
+            fclose(stats_file);
+    }
+
+done:
+    if (source.index) {
+        free(source.selected);
+        pgn_index_free(&index);
+    }
+    pgn_reader_close(&reader);
+
+    if (res)
+        return exit_error;
+    return verify_only && verify_failed ? exit_bad_games : exit_ok;
+}
+#endif
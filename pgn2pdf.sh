@@ -1,38 +1,118 @@
 #!/bin/bash
 
-if [ $# -lt 1 ]; then
-    echo "usage:    $0 <input.pgn> [start-num end-num]"
-    echo "usage: or $0 <input.pgn> [end-num] // start_num = 0"
-    echo "usage: or $0 <input.pgn> // start_num = 0, end_num = INT_MAX"
+usage() {
+    echo "usage:    $0 [-j N] [-p] <input.pgn> [start-num end-num]"
+    echo "usage: or $0 [-j N] [-p] <input.pgn> [end-num] // start_num = 0"
+    echo "usage: or $0 [-j N] [-p] <input.pgn> // start_num = 0, end_num = INT_MAX"
     echo "start-num and end-num - 0-based"
+    echo "-j N - convert N games at a time (number of cpus by default)"
+    echo "-p - write pdf with pgn2pdf.bin right away, without pdflatex"
     exit 0;
-fi;
+}
+
+JOBS=`nproc 2>/dev/null || echo 1`
+DIRECT_PDF=
+
+while getopts "j:p" opt; do
+    case $opt in
+        j) JOBS=$OPTARG ;;
+        p) DIRECT_PDF=1 ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
 
-if [ $# -eq 2 ]; then
-    startNum=0
-    endNum=$2
+if [ $# -lt 1 ]; then
+    usage
 fi;
 
-if [ $# -eq 3 ]; then
-    startNum=$2
-    endNum=$3
+RANGE=
+if [ $# -gt 1 ]; then
+    RANGE="${@:2}"
 fi;
 
-OUT_DIR=`basename $1 .pgn`
+# games are converted to LaTeX in $TEX_DIR, pdflatex makes result/<game>.pdf
+TEX_DIR=`pwd`/`basename "$1" .pgn`
+RESULT_DIR=`pwd`/result
+PICS_DIR=$RESULT_DIR/pics
+# every job works in a directory of its own, so aux files do not clash
+WORK_DIR=$TEX_DIR.work
+FAILED_DIR=$WORK_DIR/failed
+PGN2PDF=`pwd`/pgn2pdf.bin
+
+if [ -n "$DIRECT_PDF" ]; then
+    echo "Convert games in pgn to pdf"
+    exec "$PGN2PDF" -D pdf -i "$PICS_DIR" -j $JOBS "$1" "$RESULT_DIR" $RANGE
+fi
+
+mkdir -p "$RESULT_DIR" "$FAILED_DIR"
+rm -f "$FAILED_DIR"/*
+
+echo "Convert games in pgn to LaTeX"
+# games already converted by the same template keep their .tex and its time
+if ! "$PGN2PDF" -D tex -j $JOBS "$1" "$TEX_DIR" $RANGE; then
+    echo "pgn2pdf.bin failed"
+    exit 1
+fi
 
-mkdir $OUT_DIR
+# input: LaTeX file name in $TEX_DIR
+# output: return 0 if result/<game>.pdf is newer than LaTeX of the game
+up_to_date() {
+    local name=`basename "$1" .tex`
 
-echo "Convert games in pgn to directory of games"
-./pgn2dir.bin $1 $OUT_DIR $2
+    [ "$RESULT_DIR/$name.pdf" -nt "$TEX_DIR/$name.tex" ]
+}
 
-for i in `ls $OUT_DIR`; do
-    TEX_FILE=`basename $i .pgn`.tex
-    echo -e "\n\n\n================ Convert $i to $TEX_FILE ===========\n\n\n"
-    dos2unix $OUT_DIR/$i
-    ./pgn2pdf.bin $OUT_DIR/$i result/$TEX_FILE
-    echo -e "\n\n\n================ Convert $TEX_FILE pdf ===========\n\n\n"
-    cd result
-    pdflatex $TEX_FILE
-    cd ..
+# input: LaTeX file name in $TEX_DIR
+# output: result/<game>.pdf, or $FAILED_DIR/<game> with what failed
+convert_game() {
+    local name=`basename "$1" .tex`
+    local dir=$WORK_DIR/$name
+
+    mkdir -p "$dir"
+    ln -sfn "$PICS_DIR" "$dir/pics"
+
+    if ! (cd "$dir" && pdflatex -interaction=nonstopmode -halt-on-error \
+              "$TEX_DIR/$name.tex" > pdflatex.log 2>&1); then
+        echo "pdflatex, see $dir/$name.log" > "$FAILED_DIR/$name"
+        return
+    fi
+
+    mv "$dir/$name.pdf" "$RESULT_DIR/$name.pdf"
+    rm -rf "$dir"
+}
+
+echo "Convert games to pdf, $JOBS at a time"
+running=0
+total=0
+skipped=0
+for game in "$TEX_DIR"/*.tex; do
+    [ -e "$game" ] || continue
+    total=$((total + 1))
+    if up_to_date "$game"; then
+        skipped=$((skipped + 1))
+        continue
+    fi
+
+    if [ $running -ge $JOBS ]; then
+        wait -n
+        running=$((running - 1))
+    fi
+
+    convert_game "`basename "$game"`" &
+    running=$((running + 1))
 done;
+wait
+
+failed=`ls "$FAILED_DIR" | wc -l`
+echo "Converted $((total - failed - skipped)) of $total games to $RESULT_DIR" \
+     "($skipped up to date)"
+if [ $failed -ne 0 ]; then
+    echo "Failed games:"
+    for i in `ls "$FAILED_DIR"`; do
+        echo "  $i: `cat "$FAILED_DIR/$i"`"
+    done
+    exit 1
+fi
 
+rm -rf "$WORK_DIR"
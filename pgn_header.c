@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "pgn_header.h"
+
+const char *pgn_tag_names[pgn_tags_nr] = {
+    "Event", "Site", "Date", "Round", "White", "Black", "Result",
+    "FEN", "SetUp", "ECO", "WhiteElo", "BlackElo"
+};
+
+/*
+ * input: name - tag name (not null-terminated)
+ *        len - size of name
+ * output: return tag kept in header, pgn_tags_nr if it is not kept
+ */
+static enum pgn_tag_t
+find_tag(const char *name, size_t len)
+{
+    int tag;
+
+    for (tag = 0; tag < pgn_tags_nr; ++tag)
+        if (strlen(pgn_tag_names[tag]) == len &&
+            0 == memcmp(pgn_tag_names[tag], name, len))
+            return tag;
+
+    return pgn_tags_nr;
+}
+
+/*
+ * input: game - game data (not null-terminated)
+ *        len - size of game
+ * output: header - values of tags kept, the first one of a tag repeated,
+ *                  and where movetext starts
+ *         tag section is read once, nothing after it is looked at,
+ *         the second "[Event" tag ends it too
+ */
+void
+pgn_header_parse(pgn_header_t *header, const char *game, size_t len)
+{
+    size_t i = 0, start, name, name_len, value;
+    enum pgn_tag_t tag;
+    char c;
+
+    memset(header->tags, 0, sizeof(header->tags));
+
+    while (i < len) {
+        c = game[i];
+        if (' ' == c || '\t' == c || '\r' == c || '\n' == c) {
+            ++i;
+            continue;
+        }
+        // escape line
+        if ('%' == c && (0 == i || '\n' == game[i - 1])) {
+            while (i < len && '\n' != game[i]) ++i;
+            continue;
+        }
+        if ('[' != c) break;
+
+        start = i;
+        for (++i; i < len && (' ' == game[i] || '\t' == game[i]); ++i);
+        for (name = i; i < len && ' ' != game[i] && '\t' != game[i] &&
+                       '"' != game[i] && ']' != game[i] && '\n' != game[i]; ++i);
+        name_len = i - name;
+        for (; i < len && (' ' == game[i] || '\t' == game[i]); ++i);
+
+        if (i < len && '"' == game[i]) {
+            // value ends with quote not escaped, on the same line
+            for (value = ++i; i < len && '"' != game[i] && '\n' != game[i]; ++i)
+                if ('\\' == game[i] && i + 1 < len && '\n' != game[i + 1]) ++i;
+
+            tag = find_tag(game + name, name_len);
+            // game without movetext, the next one starts here
+            if (pgn_tag_event == tag && header->tags[tag].str) {
+                i = start;
+                break;
+            }
+            if (i < len && '"' == game[i] && tag < pgn_tags_nr &&
+                NULL == header->tags[tag].str) {
+                header->tags[tag].str = game + value;
+                header->tags[tag].len = i - value;
+            }
+        }
+
+        // rest of tag pair
+        while (i < len && ']' != game[i] && '\n' != game[i]) ++i;
+        if (i < len && ']' == game[i]) ++i;
+    }
+
+    header->movetext = i;
+}
+
+/*
+ * input: header - header parsed
+ *        tag - tag wanted
+ * output: return tag value, "?" if there is no such tag
+ *         len - size of value
+ */
+const char *
+pgn_header_value(const pgn_header_t *header, enum pgn_tag_t tag, int *len)
+{
+    if (NULL == header->tags[tag].str) {
+        *len = 1;
+        return "?";
+    }
+
+    *len = header->tags[tag].len;
+    return header->tags[tag].str;
+}
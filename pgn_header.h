@@ -0,0 +1,44 @@
+#ifndef PGN_HEADER_H
+#define PGN_HEADER_H
+
+#include <stddef.h>
+
+// tags kept from tag section: seven tag roster and a few more
+enum pgn_tag_t {
+    pgn_tag_event = 0,
+    pgn_tag_site,
+    pgn_tag_date,
+    pgn_tag_round,
+    pgn_tag_white,
+    pgn_tag_black,
+    pgn_tag_result,
+    pgn_tag_fen,
+    pgn_tag_setup,
+    pgn_tag_eco,
+    pgn_tag_white_elo,
+    pgn_tag_black_elo,
+    pgn_tags_nr
+};
+
+// tag value between quotes, escapes kept, pointing into game
+// (NULL when the game has no such tag)
+typedef struct {
+    const char *str;
+    int len;
+} pgn_tag_value_t;
+
+typedef struct {
+    pgn_tag_value_t tags[pgn_tags_nr];
+    // offset of movetext in game, size of game if there is none
+    size_t movetext;
+} pgn_header_t;
+
+extern const char *pgn_tag_names[pgn_tags_nr];
+
+void
+pgn_header_parse(pgn_header_t *header, const char *game, size_t len);
+
+const char *
+pgn_header_value(const pgn_header_t *header, enum pgn_tag_t tag, int *len);
+
+#endif
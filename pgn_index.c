@@ -0,0 +1,607 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <linux/limits.h>
+
+#include "pgn_index.h"
+
+/*
+ * input: value - result as in "[Result" tag value
+ * output: return result, result_unknown if it is not a result
+ */
+enum game_result_t
+pgn_parse_result_value(const char *value)
+{
+    if (0 == strcmp(value, "1-0")) return result_white_wins;
+    if (0 == strcmp(value, "0-1")) return result_black_wins;
+    if (0 == strcmp(value, "1/2-1/2")) return result_draw;
+
+    return result_unknown;
+}
+
+/*
+ * input: header - tags of game
+ * output: return result, result_unknown if there is no "[Result" tag
+ *         or its value is not a result
+ */
+enum game_result_t
+pgn_header_result(const pgn_header_t *header)
+{
+    const pgn_tag_value_t *value = &header->tags[pgn_tag_result];
+
+    if (value->len == 3 && 0 == memcmp(value->str, "1-0", 3))
+        return result_white_wins;
+    if (value->len == 3 && 0 == memcmp(value->str, "0-1", 3))
+        return result_black_wins;
+    if (value->len == 7 && 0 == memcmp(value->str, "1/2-1/2", 7))
+        return result_draw;
+
+    return result_unknown;
+}
+
+/*
+ * input: game - game data (not null-terminated)
+ *        len - size of game
+ * output: return result from "[Result" tag of the game
+ */
+enum game_result_t
+pgn_game_result(const char *game, size_t len)
+{
+    pgn_header_t header;
+
+    pgn_header_parse(&header, game, len);
+    return pgn_header_result(&header);
+}
+
+/*
+ * input: to - where to store file name
+ *        dir - directory of games
+ *        k - game number in pgn-file (0-based)
+ *        result - result of the game
+ *        suffix - file suffix with dot, like ".pgn"
+ * output: to - "<dir>/game-<k>[-ww|-bw|-00]<suffix>"
+ */
+void
+pgn_game_name(char *to, const char *dir, int k,
+              enum game_result_t result, const char *suffix)
+{
+    const char *tag;
+
+    switch (result) {
+        case result_white_wins:
+            tag = "-ww";
+            break;
+        case result_black_wins:
+            tag = "-bw";
+            break;
+        case result_draw:
+            tag = "-00";
+            break;
+        default:
+            tag = "";
+            break;
+    }
+
+    snprintf(to, PATH_MAX, "%s/game-%d%s%s", dir, k, tag, suffix);
+}
+
+/*
+ * input: name - file to check
+ *        key - content it should have
+ * output: return 1 if file exists with exactly key in it, 0 otherwise
+ */
+int
+pgn_same_key(const char *name, const char *key)
+{
+    FILE *in;
+    char stored[64];
+    size_t len;
+
+    in = fopen(name, "r");
+    if (!in) return 0;
+    len = fread(stored, 1, sizeof(stored) - 1, in);
+    fclose(in);
+    stored[len] = '\0';
+
+    return 0 == strcmp(stored, key);
+}
+
+#define NO_ID ((uint32_t)-1)
+
+static uint32_t
+hash_string(const char *value, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    while (len--) {
+        hash ^= (unsigned char)*value++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * input: index - index being built
+ *        size - new size of ids table (power of 2)
+ * output: return success/failed (out of memory)
+ */
+static reader_result_t
+rehash_ids(pgn_index_t *index, uint32_t size)
+{
+    uint32_t *ids;
+    uint32_t id, i;
+    const char *value;
+
+    ids = malloc(sizeof(uint32_t) * size);
+    if (NULL == ids) return failed;
+    memset(ids, 0xff, sizeof(uint32_t) * size);
+
+    for (id = 0; id < index->strings_nr; ++id) {
+        value = index->pool + index->strings[id];
+        i = hash_string(value, strlen(value)) & (size - 1);
+        while (NO_ID != ids[i])
+            i = (i + 1) & (size - 1);
+        ids[i] = id;
+    }
+
+    free(index->ids);
+    index->ids = ids;
+    index->ids_size = size;
+    return success;
+}
+
+/*
+ * input: index - index being built
+ *        value - tag value (not null-terminated)
+ *        len - size of value
+ * output: return id of the value in strings table, NO_ID if out of memory
+ */
+static uint32_t
+intern(pgn_index_t *index, const char *value, size_t len)
+{
+    uint32_t i, id, offset;
+    void *bigger;
+
+    if (index->strings_nr * 2 >= index->ids_size &&
+        rehash_ids(index, index->ids_size ? index->ids_size * 2 : 1024) == failed)
+        return NO_ID;
+
+    i = hash_string(value, len) & (index->ids_size - 1);
+    while (NO_ID != (id = index->ids[i])) {
+        offset = index->strings[id];
+        if (offset + len < index->pool_len &&
+            0 == memcmp(index->pool + offset, value, len) &&
+            '\0' == index->pool[offset + len])
+            return id;
+        i = (i + 1) & (index->ids_size - 1);
+    }
+
+    if (index->strings_nr == index->strings_size) {
+        index->strings_size = index->strings_size ? index->strings_size * 2 : 1024;
+        bigger = realloc(index->strings, sizeof(uint32_t) * index->strings_size);
+        if (NULL == bigger) return NO_ID;
+        index->strings = bigger;
+    }
+
+    while (index->pool_len + len + 1 > index->pool_size) {
+        index->pool_size = index->pool_size ? index->pool_size * 2 : 16384;
+        bigger = realloc(index->pool, index->pool_size);
+        if (NULL == bigger) return NO_ID;
+        index->pool = bigger;
+    }
+
+    memcpy(index->pool + index->pool_len, value, len);
+    index->pool[index->pool_len + len] = '\0';
+
+    id = index->strings_nr++;
+    index->strings[id] = index->pool_len;
+    index->pool_len += len + 1;
+    index->ids[i] = id;
+
+    return id;
+}
+
+/*
+ * input: index - index being built
+ *        header - tags of game
+ *        tag - tag to intern
+ * output: return id of the tag value, "?" when there is no such tag
+ */
+static uint32_t
+intern_tag_value(pgn_index_t *index, const pgn_header_t *header,
+                 enum pgn_tag_t tag)
+{
+    const char *value;
+    int len;
+
+    value = pgn_header_value(header, tag, &len);
+    return intern(index, value, len);
+}
+
+/*
+ * input: index - index to fill
+ *        data - whole pgn-file
+ *        len - size of data
+ * output: return success/failed (out of memory)
+ *         index - offset, length, result and White/Black/Event/Date
+ *                 of every game, tag sections parsed once, movetext
+ *                 only searched for the next game start
+ */
+reader_result_t
+pgn_index_build(pgn_index_t *index, const char *data, size_t len)
+{
+    const char *found;
+    size_t pos = 0;
+    pgn_index_entry_t *game;
+    pgn_index_entry_t *bigger;
+    pgn_header_t header;
+    uint32_t i;
+
+    memset(index, 0, sizeof(*index));
+
+    // missing tags are "?" as in PGN standard
+    if (NO_ID == intern(index, "?", 1)) {
+        pgn_index_free(index);
+        return failed;
+    }
+
+    while (pos < len) {
+        // game starts with "[Event" tag at the beginning of a line,
+        // tags before the first game are skipped
+        found = memmem(data + pos, len - pos, "[Event", 6);
+        if (NULL == found) break;
+        pos = found - data;
+        if ((pos > 0 && '\n' != data[pos - 1]) ||
+            !pgn_is_tag(found, len - pos, "Event")) {
+            ++pos;
+            continue;
+        }
+
+        if (index->games_nr == index->games_size) {
+            index->games_size = index->games_size ?
+                                index->games_size * 2 : 1024;
+            bigger = realloc(index->games,
+                             sizeof(pgn_index_entry_t) * index->games_size);
+            if (NULL == bigger) {
+                pgn_index_free(index);
+                return failed;
+            }
+            index->games = bigger;
+        }
+
+        game = &index->games[index->games_nr++];
+        game->offset = pos;
+        pgn_header_parse(&header, found, len - pos);
+        game->result = pgn_header_result(&header);
+        game->event = intern_tag_value(index, &header, pgn_tag_event);
+        game->white = intern_tag_value(index, &header, pgn_tag_white);
+        game->black = intern_tag_value(index, &header, pgn_tag_black);
+        game->date = intern_tag_value(index, &header, pgn_tag_date);
+        if (NO_ID == game->event || NO_ID == game->white ||
+            NO_ID == game->black || NO_ID == game->date) {
+            pgn_index_free(index);
+            return failed;
+        }
+
+        pos += header.movetext;
+    }
+
+    for (i = 0; i < index->games_nr; ++i)
+        index->games[i].length = (i + 1 < index->games_nr ?
+                                  index->games[i + 1].offset : len) -
+                                 index->games[i].offset;
+
+    // only needed to intern
+    free(index->ids);
+    index->ids = NULL;
+    index->ids_size = 0;
+
+    return success;
+}
+
+/*
+ * input: to - where to store index file name
+ *        pgn_path - pgn-file name
+ * output: to - "games.pgnidx" for "games.pgn", "<pgn_path>.pgnidx" otherwise
+ */
+static void
+index_name(char *to, const char *pgn_path)
+{
+    int len = strlen(pgn_path);
+
+    if (len > 4 && 0 == strcmp(pgn_path + len - 4, ".pgn"))
+        snprintf(to, PATH_MAX, "%sidx", pgn_path);
+    else
+        snprintf(to, PATH_MAX, "%s.pgnidx", pgn_path);
+}
+
+/*
+ * input: index - index to fill
+ *        path - index file name
+ *        st - stat of pgn-file
+ * output: return success if index file is there and is up to date
+ *         index - entries mapped from index file
+ */
+static reader_result_t
+index_load(pgn_index_t *index, const char *path, const struct stat *st)
+{
+    int fd;
+    struct stat idx_st;
+    pgn_index_header_t *header;
+    void *map;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return failed;
+
+    if (fstat(fd, &idx_st) < 0 || idx_st.st_size < sizeof(pgn_index_header_t)) {
+        close(fd);
+        return failed;
+    }
+
+    map = mmap(NULL, idx_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map) return failed;
+
+    header = map;
+    if (memcmp(header->magic, PGN_INDEX_MAGIC, sizeof(PGN_INDEX_MAGIC)) ||
+        header->version != PGN_INDEX_VERSION ||
+        header->source_size != st->st_size ||
+        header->source_mtime != st->st_mtim.tv_sec ||
+        header->source_mtime_nsec != st->st_mtim.tv_nsec ||
+        idx_st.st_size != sizeof(pgn_index_header_t) +
+                          sizeof(pgn_index_entry_t) * (size_t)header->games_nr +
+                          sizeof(uint32_t) * (size_t)header->strings_nr +
+                          header->pool_len) {
+        munmap(map, idx_st.st_size);
+        return failed;
+    }
+
+    memset(index, 0, sizeof(*index));
+    index->map = map;
+    index->map_len = idx_st.st_size;
+    index->games = (pgn_index_entry_t *)(header + 1);
+    index->games_nr = header->games_nr;
+    index->strings = (uint32_t *)(index->games + index->games_nr);
+    index->strings_nr = header->strings_nr;
+    index->pool = (char *)(index->strings + index->strings_nr);
+    index->pool_len = header->pool_len;
+
+    return success;
+}
+
+/*
+ * input: index - built index
+ *        path - index file name
+ *        st - stat of pgn-file
+ * output: return success/failed (errno is set then)
+ */
+static reader_result_t
+index_save(const pgn_index_t *index, const char *path, const struct stat *st)
+{
+    char tmp_path[PATH_MAX];
+    pgn_index_header_t header;
+    FILE *out;
+    int ok;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    out = fopen(tmp_path, "w");
+    if (NULL == out) return failed;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PGN_INDEX_MAGIC, sizeof(PGN_INDEX_MAGIC));
+    header.version = PGN_INDEX_VERSION;
+    header.games_nr = index->games_nr;
+    header.strings_nr = index->strings_nr;
+    header.pool_len = index->pool_len;
+    header.source_size = st->st_size;
+    header.source_mtime = st->st_mtim.tv_sec;
+    header.source_mtime_nsec = st->st_mtim.tv_nsec;
+
+    ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+         fwrite(index->games, sizeof(pgn_index_entry_t),
+                index->games_nr, out) == index->games_nr &&
+         fwrite(index->strings, sizeof(uint32_t),
+                index->strings_nr, out) == index->strings_nr &&
+         fwrite(index->pool, 1, index->pool_len, out) == index->pool_len;
+    ok = (0 == fclose(out)) && ok;
+
+    // readers never see half-written index
+    if (!ok || rename(tmp_path, path) < 0) {
+        unlink(tmp_path);
+        return failed;
+    }
+
+    return success;
+}
+
+/*
+ * input: index - index to fill
+ *        pgn_path - pgn-file name
+ *        reader - reader opened for pgn_path
+ * output: return success/failed (input is not a mapped file)
+ *         index - loaded from index file next to pgn-file if it is up
+ *                 to date, built and saved there otherwise
+ */
+reader_result_t
+pgn_index_open(pgn_index_t *index, const char *pgn_path, pgn_reader_t *reader)
+{
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (!reader->mapped || fstat(reader->fd, &st) < 0)
+        return failed;
+
+    index_name(path, pgn_path);
+    if (index_load(index, path, &st) == success)
+        return success;
+
+    if (pgn_index_build(index, reader->data, reader->len) == failed)
+        return failed;
+
+    if (index_save(index, path, &st) == failed)
+        fprintf(stderr, "cant save index '%s': %s\n", path, strerror(errno));
+
+    return success;
+}
+
+const char *
+pgn_index_string(const pgn_index_t *index, uint32_t id)
+{
+    if (id >= index->strings_nr) return "?";
+    return index->pool + index->strings[id];
+}
+
+void
+pgn_query_init(pgn_query_t *query)
+{
+    memset(query, 0, sizeof(*query));
+    query->result = -1;
+}
+
+/*
+ * input: query - query to fill
+ *        opt - option from PGN_QUERY_OPTIONS
+ *        arg - its argument
+ * output: return 1 - option taken, 0 - not a query option,
+ *                -1 - bad argument
+ */
+int
+pgn_query_option(pgn_query_t *query, int opt, const char *arg)
+{
+    switch (opt) {
+        case 'w':
+            query->white = arg;
+            return 1;
+        case 'b':
+            query->black = arg;
+            return 1;
+        case 'p':
+            query->player = arg;
+            return 1;
+        case 'e':
+            query->event = arg;
+            return 1;
+        case 'd':
+            query->date = arg;
+            return 1;
+        case 'r':
+            query->result = pgn_parse_result_value(arg);
+            if (result_unknown == query->result) {
+                fprintf(stderr, "unknown result '%s'\n", arg);
+                return -1;
+            }
+            return 1;
+    }
+
+    return 0;
+}
+
+int
+pgn_query_empty(const pgn_query_t *query)
+{
+    return !query->white && !query->black && !query->player &&
+           !query->event && !query->date && query->result < 0;
+}
+
+/*
+ * input: index - index to look in
+ *        pattern - substring to look for, or NULL
+ * output: return NULL for NULL pattern, or allocated array with
+ *         1 for every string id matching pattern
+ */
+static char *
+match_strings(const pgn_index_t *index, const char *pattern)
+{
+    char *matches;
+    uint32_t id;
+
+    if (NULL == pattern) return NULL;
+
+    matches = malloc(index->strings_nr + 1);
+    if (NULL == matches) return NULL;
+
+    // every distinct value is looked at once, not once per game
+    for (id = 0; id < index->strings_nr; ++id)
+        matches[id] = NULL != strcasestr(index->pool + index->strings[id], pattern);
+
+    return matches;
+}
+
+/*
+ * input: index - index to select from
+ *        query - what games to select
+ * output: return success/failed (out of memory)
+ *         games - allocated array of numbers of selected games
+ *         games_nr - size of games
+ */
+reader_result_t
+pgn_index_select(const pgn_index_t *index, const pgn_query_t *query,
+                 uint32_t **games, uint32_t *games_nr)
+{
+    char *white, *black, *player, *event, *date;
+    const pgn_index_entry_t *game;
+    reader_result_t res = success;
+    uint32_t i;
+
+    white = match_strings(index, query->white);
+    black = match_strings(index, query->black);
+    player = match_strings(index, query->player);
+    event = match_strings(index, query->event);
+    date = match_strings(index, query->date);
+
+    *games_nr = 0;
+    *games = malloc(sizeof(uint32_t) * (index->games_nr + 1));
+
+    if (NULL == *games ||
+        (query->white && !white) || (query->black && !black) ||
+        (query->player && !player) || (query->event && !event) ||
+        (query->date && !date)) {
+        free(*games);
+        *games = NULL;
+        res = failed;
+    } else {
+        for (i = 0; i < index->games_nr; ++i) {
+            game = &index->games[i];
+
+            if (white && !white[game->white]) continue;
+            if (black && !black[game->black]) continue;
+            if (player && !player[game->white] && !player[game->black]) continue;
+            if (event && !event[game->event]) continue;
+            if (date && !date[game->date]) continue;
+            if (query->result >= 0 && query->result != game->result) continue;
+
+            (*games)[(*games_nr)++] = i;
+        }
+    }
+
+    free(white);
+    free(black);
+    free(player);
+    free(event);
+    free(date);
+
+    return res;
+}
+
+void
+pgn_index_free(pgn_index_t *index)
+{
+    if (index->map) {
+        munmap(index->map, index->map_len);
+    } else {
+        free(index->games);
+        free(index->strings);
+        free(index->pool);
+    }
+    free(index->ids);
+
+    memset(index, 0, sizeof(*index));
+}
@@ -0,0 +1,131 @@
+#ifndef PGN_INDEX_H
+#define PGN_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pgn_reader.h"
+#include "pgn_header.h"
+
+#define PGN_INDEX_MAGIC "PGNIDX"
+#define PGN_INDEX_VERSION 3
+
+// game result as stored in index
+enum game_result_t {
+    result_unknown = 0,
+    result_white_wins = 1,
+    result_black_wins = 2,
+    result_draw = 3
+};
+
+// one game of pgn-file
+typedef struct {
+    // where the game starts ("[Event" tag) in pgn-file
+    uint64_t offset;
+    // up to the next game start
+    uint32_t length;
+    // enum game_result_t
+    uint32_t result;
+    // ids of tag values in strings table, "?" for missing tags
+    uint32_t white;
+    uint32_t black;
+    uint32_t event;
+    uint32_t date;
+} pgn_index_entry_t;
+
+// index file is this header followed by games_nr entries,
+// strings_nr offsets of strings in pool and pool_len bytes of pool
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t games_nr;
+    uint32_t strings_nr;
+    uint32_t pool_len;
+    // pgn-file the index was built for
+    uint64_t source_size;
+    int64_t source_mtime;
+    int64_t source_mtime_nsec;
+} pgn_index_header_t;
+
+typedef struct {
+    pgn_index_entry_t *games;
+    uint32_t games_nr;
+    // allocated entries when built, 0 when mapped from index file
+    uint32_t games_size;
+    // interned tag values: null-terminated strings[id] in pool
+    uint32_t *strings;
+    uint32_t strings_nr;
+    uint32_t strings_size;
+    char *pool;
+    uint32_t pool_len;
+    uint32_t pool_size;
+    // string id by hash while building, open addressing
+    uint32_t *ids;
+    uint32_t ids_size;
+    void *map;
+    size_t map_len;
+} pgn_index_t;
+
+// what games to select from index, NULL/-1 fields match any game
+typedef struct {
+    // case-insensitive substrings of tag values
+    const char *white;
+    const char *black;
+    // white or black
+    const char *player;
+    const char *event;
+    const char *date;
+    // enum game_result_t or -1
+    int result;
+} pgn_query_t;
+
+#define PGN_QUERY_OPTIONS "w:b:p:e:d:r:"
+#define PGN_QUERY_USAGE \
+"  -w <white>, -b <black> - select games of the white/black player\n" \
+"  -p <player> - select games of the player by either color\n" \
+"  -e <event>, -d <date> - select games of the event/date\n" \
+"      names, events and dates match as case-insensitive substrings\n" \
+"  -r <1-0|0-1|1/2-1/2> - select games with the result\n"
+
+enum game_result_t
+pgn_parse_result_value(const char *value);
+
+enum game_result_t
+pgn_header_result(const pgn_header_t *header);
+
+enum game_result_t
+pgn_game_result(const char *game, size_t len);
+
+void
+pgn_game_name(char *to, const char *dir, int k,
+              enum game_result_t result, const char *suffix);
+
+int
+pgn_same_key(const char *name, const char *key);
+
+reader_result_t
+pgn_index_build(pgn_index_t *index, const char *data, size_t len);
+
+reader_result_t
+pgn_index_open(pgn_index_t *index, const char *pgn_path, pgn_reader_t *reader);
+
+const char *
+pgn_index_string(const pgn_index_t *index, uint32_t id);
+
+void
+pgn_query_init(pgn_query_t *query);
+
+int
+pgn_query_option(pgn_query_t *query, int opt, const char *arg);
+
+int
+pgn_query_empty(const pgn_query_t *query);
+
+reader_result_t
+pgn_index_select(const pgn_index_t *index, const pgn_query_t *query,
+                 uint32_t **games, uint32_t *games_nr);
+
+void
+pgn_index_free(pgn_index_t *index);
+
+#endif
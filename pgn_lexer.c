@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include "pgn_lexer.h"
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/*
+ * input: c - character
+ * output: return 1 if c may be a part of SAN, move number or result
+ */
+static inline int
+is_symbol(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || IS_DIGIT(c) ||
+           c == '_' || c == '+' || c == '#' || c == '=' || c == ':' ||
+           c == '-' || c == '/';
+}
+
+/*
+ * input: text - symbol
+ *        len - length of text
+ * output: return 1 if text is game termination marker
+ */
+static inline int
+is_result(const char *text, int len)
+{
+    return (len == 3 && (!memcmp(text, "1-0", 3) || !memcmp(text, "0-1", 3))) ||
+           (len == 7 && !memcmp(text, "1/2-1/2", 7));
+}
+
+/*
+ * input: lexer - lexer to set up
+ *        in - movetext (not null-terminated), must outlive lexer
+ *        len - size of in
+ */
+void
+pgn_lexer_init(pgn_lexer_t *lexer, const char *in, int len)
+{
+    lexer->in = in;
+    lexer->len = len;
+    lexer->pos = 0;
+}
+
+/*
+ * input: lexer - lexer
+ * output: return type of token read, token_end at the end of input
+ *         token - the token, text points into lexer input
+ */
+enum pgn_token_type_t
+pgn_lexer_next(pgn_lexer_t *lexer, pgn_token_t *token)
+{
+    const char *in = lexer->in;
+    const char *found;
+    int len = lexer->len;
+    int i = lexer->pos;
+    int start;
+
+    for (;;) {
+        while (i < len && IS_SPACE(in[i])) ++i;
+        if (i >= len) {
+            lexer->pos = len;
+            token->type = token_end;
+            token->text = in + len;
+            token->len = 0;
+            return token_end;
+        }
+
+        // escape line "%..." at the beginning of line is skipped
+        if (in[i] == '%' && (i == 0 || in[i - 1] == '\n')) {
+            found = memchr(in + i, '\n', len - i);
+            i = found ? found - in : len;
+            continue;
+        }
+
+        // stray periods (like "1 ... e5") and unknown characters
+        if (!is_symbol(in[i]) && !strchr("{;()$!?*", in[i])) {
+            ++i;
+            continue;
+        }
+
+        break;
+    }
+
+    start = i;
+    switch (in[i]) {
+        case '{' :
+        case ';' :
+            found = memchr(in + i + 1, in[i] == '{' ? '}' : '\n', len - i - 1);
+            token->type = token_comment;
+            token->text = in + i + 1;
+            token->len = (found ? found - in : len) - i - 1;
+            i = found ? found - in + 1 : len;
+            // ";" comment of CRLF line ends before '\r'
+            if (in[start] == ';' && token->len > 0 && token->text[token->len - 1] == '\r')
+                --token->len;
+            break;
+
+        case '(' :
+        case ')' :
+            token->type = in[i] == '(' ? token_rav_open : token_rav_close;
+            token->text = in + i;
+            token->len = 1;
+            ++i;
+            break;
+
+        case '$' :
+            for (++i; i < len && IS_DIGIT(in[i]); ++i);
+            token->type = token_nag;
+            token->text = in + start + 1;
+            token->len = i - start - 1;
+            break;
+
+        case '!' :
+        case '?' :
+            for (++i; i < len && (in[i] == '!' || in[i] == '?'); ++i);
+            token->type = token_nag;
+            token->text = in + start;
+            token->len = i - start;
+            break;
+
+        case '*' :
+            token->type = token_result;
+            token->text = in + i;
+            token->len = 1;
+            ++i;
+            break;
+
+        default :
+            for (++i; i < len && is_symbol(in[i]); ++i);
+            token->text = in + start;
+            token->len = i - start;
+
+            if (is_result(token->text, token->len)) {
+                token->type = token_result;
+                break;
+            }
+
+            for (i = start; i < start + token->len && IS_DIGIT(in[i]); ++i);
+            if (i == start + token->len) {
+                // move number and its periods
+                token->type = token_move_number;
+                while (i < len && in[i] == '.') ++i;
+                break;
+            }
+
+            token->type = token_san;
+            i = start + token->len;
+            break;
+    }
+
+    lexer->pos = i;
+    return token->type;
+}
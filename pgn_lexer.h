@@ -0,0 +1,42 @@
+#ifndef PGN_LEXER_H
+#define PGN_LEXER_H
+
+// movetext token types
+enum pgn_token_type_t {
+    token_end = 0,
+    // "12." or "12..." (text is the number only)
+    token_move_number,
+    // move in standard algebraic notation, without annotation glyphs
+    token_san,
+    // "$<integer>" (text is the number) or glyph like "!?"
+    token_nag,
+    // {...} or ;... up to end of line (text is without braces/semicolon)
+    token_comment,
+    // '(' and ')' of recursive annotation variation
+    token_rav_open,
+    token_rav_close,
+    // game termination: 1-0, 0-1, 1/2-1/2 or *
+    token_result
+};
+
+// token is a view of lexer input, it is not null-terminated
+typedef struct {
+    enum pgn_token_type_t type;
+    const char *text;
+    int len;
+} pgn_token_t;
+
+// lexer state, one per movetext being read
+typedef struct {
+    const char *in;
+    int len;
+    int pos;
+} pgn_lexer_t;
+
+void
+pgn_lexer_init(pgn_lexer_t *lexer, const char *in, int len);
+
+enum pgn_token_type_t
+pgn_lexer_next(pgn_lexer_t *lexer, pgn_token_t *token);
+
+#endif
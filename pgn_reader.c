@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "pgn_reader.h"
+
+static const char GameStart[] = "[Event";
+
+/*
+ * input: in - data to check
+ *        len - bytes available in in
+ *        tag - tag name (like "Event")
+ * output: return 1 if in starts with tag pair of the tag, 0 otherwise
+ */
+int
+pgn_is_tag(const char *in, size_t len, const char *tag)
+{
+    size_t tag_len = strlen(tag);
+
+    if (len < tag_len + 2 || '[' != in[0]) return 0;
+    if (memcmp(in + 1, tag, tag_len)) return 0;
+
+    // "[Event " but not "[EventDate "
+    return ' ' == in[tag_len + 1] || '\t' == in[tag_len + 1];
+}
+
+/*
+ * input: in - data to hash (like raw game)
+ *        len - size of in
+ * output: return 64-bit FNV-1a hash of in
+ */
+uint64_t
+pgn_hash64(const char *in, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)in[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+/*
+ * input: in - data to look in
+ *        from - where to start looking
+ *        len - size of in
+ * output: return offset of game start in in, or len if there is none
+ *         game starts with "[Event" tag at the beginning of a line
+ */
+static size_t
+locate_game(const char *in, size_t from, size_t len)
+{
+    const char *found;
+
+    while (from < len) {
+        found = memmem(in + from, len - from, GameStart, sizeof(GameStart) - 1);
+        if (NULL == found) return len;
+
+        from = found - in;
+        if ((0 == from || '\n' == in[from - 1]) &&
+            pgn_is_tag(found, len - from, "Event"))
+            return from;
+
+        ++from;
+    }
+
+    return len;
+}
+
+/*
+ * input in - string with file-data read
+ *       idx - pointer to int where to store index of starting game
+ *       len - size of in string
+ * output idx - index to strating game in char *in
+ */
+reader_result_t
+find_next_game(const char *in, int *idx, int len)
+{
+    size_t found;
+
+    found = locate_game(in, idx[0], len);
+    if (found == len) return failed;
+
+    idx[0] = found;
+    return success;
+}
+
+/*
+ * input: reader - window reader
+ * output: return 0 - read something or reached eof, -1 - read failed
+ *         reader - window with unconsumed data moved to its start
+ */
+static int
+refill_window(pgn_reader_t *reader)
+{
+    ssize_t got;
+    char *bigger;
+
+    // drop what is already consumed,
+    // but the byte before pos to tell if pos starts a line
+    if (reader->pos > 1) {
+        memmove(reader->data, reader->data + reader->pos - 1,
+                reader->len - reader->pos + 1);
+        reader->len -= reader->pos - 1;
+        reader->pos = 1;
+    }
+
+    // whole window is one unfinished game, let it grow
+    if (reader->len == reader->size) {
+        bigger = realloc(reader->data, reader->size * 2);
+        if (NULL == bigger) return -1;
+        reader->data = bigger;
+        reader->size *= 2;
+    }
+
+    do {
+        got = read(reader->fd, reader->data + reader->len,
+                   reader->size - reader->len);
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0) return -1;
+    if (got == 0) reader->eof = 1;
+
+    reader->len += got;
+    return 0;
+}
+
+/*
+ * input: reader - reader to set up
+ *        path - pgn-file to read, "-" for stdin
+ * output: return success/failed (errno is set then)
+ *         reader - mapped file if it is regular one, window otherwise
+ */
+reader_result_t
+pgn_reader_open(pgn_reader_t *reader, const char *path)
+{
+    struct stat st;
+    void *map;
+
+    memset(reader, 0, sizeof(*reader));
+
+    if (0 == strcmp(path, "-")) {
+        reader->fd = STDIN_FILENO;
+    } else {
+        reader->fd = open(path, O_RDONLY);
+        if (reader->fd < 0) return failed;
+    }
+
+    if (fstat(reader->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+        if (MAP_FAILED != map) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            reader->mapped = 1;
+            reader->data = map;
+            reader->size = reader->len = st.st_size;
+            return success;
+        }
+    }
+
+    // pipes, stdin and files mmap() refused
+    reader->size = PGN_READER_WINDOW;
+    reader->data = malloc(reader->size);
+    if (NULL == reader->data) {
+        pgn_reader_close(reader);
+        return failed;
+    }
+
+    return success;
+}
+
+/*
+ * input: reader - opened reader
+ * output: return success - game found, failed - no more games
+ *         game - pointer to the game start (not null-terminated),
+ *                valid up to the next call
+ *         len - length of the game, up to the next game start
+ */
+reader_result_t
+pgn_reader_next_game(pgn_reader_t *reader, char **game, int *len)
+{
+    size_t start, end;
+    size_t page;
+
+    for (;;) {
+        start = locate_game(reader->data, reader->pos, reader->len);
+
+        if (start < reader->len) {
+            end = locate_game(reader->data, start + 1, reader->len);
+            if (end < reader->len || reader->mapped || reader->eof)
+                break;
+            // game may continue beyond window
+            reader->pos = start;
+        } else {
+            if (reader->mapped || reader->eof) return failed;
+            // keep tail that may be the beginning of GameStart
+            if (reader->len > sizeof(GameStart))
+                reader->pos = reader->len - sizeof(GameStart);
+        }
+
+        if (refill_window(reader) < 0) return failed;
+    }
+
+    if (reader->mapped) {
+        // pages of previous games are not needed any more
+        page = sysconf(_SC_PAGESIZE);
+        if ((start & ~(page - 1)) > reader->released) {
+            madvise(reader->data + reader->released,
+                    (start & ~(page - 1)) - reader->released,
+                    MADV_DONTNEED);
+            reader->released = start & ~(page - 1);
+        }
+    }
+
+    *game = reader->data + start;
+    *len = end - start;
+    reader->pos = end;
+    return success;
+}
+
+void
+pgn_reader_close(pgn_reader_t *reader)
+{
+    if (reader->mapped)
+        munmap(reader->data, reader->size);
+    else
+        free(reader->data);
+
+    if (reader->fd > STDIN_FILENO)
+        close(reader->fd);
+
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,55 @@
+#ifndef PGN_READER_H
+#define PGN_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// read_* functions result type
+typedef enum {
+    failed = 0,
+    success = 1
+} reader_result_t;
+
+// initial size of streaming window, grows only for longer games
+#ifndef PGN_READER_WINDOW
+#define PGN_READER_WINDOW (1 << 20)
+#endif
+
+// reader over pgn-file, gives one game at a time
+typedef struct {
+    int fd;
+    // is data mmap()-ed file (1) or streaming window (0)?
+    int mapped;
+    // mapped file or window buffer
+    char *data;
+    // size of mapping or capacity of window
+    size_t size;
+    // bytes available in data
+    size_t len;
+    // where to look for the next game in data
+    size_t pos;
+    // mapped bytes already given back to kernel
+    size_t released;
+    // is end of input reached? (window only)
+    int eof;
+} pgn_reader_t;
+
+int
+pgn_is_tag(const char *in, size_t len, const char *tag);
+
+uint64_t
+pgn_hash64(const char *in, size_t len);
+
+reader_result_t
+find_next_game(const char *in, int *idx, int len);
+
+reader_result_t
+pgn_reader_open(pgn_reader_t *reader, const char *path);
+
+reader_result_t
+pgn_reader_next_game(pgn_reader_t *reader, char **game, int *len);
+
+void
+pgn_reader_close(pgn_reader_t *reader);
+
+#endif
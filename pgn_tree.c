@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include "pgn_tree.h"
+
+// deepest variation nesting kept, deeper ones are skipped
+#define PGN_TREE_DEPTH 64
+
+// line being read: where its next move goes
+typedef struct {
+    // last move of the line, NULL before the first one
+    pgn_move_t *last;
+    // where the first move is linked to
+    pgn_move_t **first;
+    // move the line's first move is alternative to
+    pgn_move_t *alternative;
+    // comments before the first move, given to it when it comes
+    pgn_comment_t *pending;
+} pgn_line_t;
+
+/*
+ * input: token - token_nag
+ * output: return NAG code of "$<integer>" or of glyph like "!?", 0 if unknown
+ */
+static unsigned char
+nag_code(const pgn_token_t *token)
+{
+    static const char *glyphs[] = { "", "!", "?", "!!", "??", "!?", "?!" };
+    unsigned int code = 0;
+    int i;
+
+    if (token->len && (token->text[0] == '!' || token->text[0] == '?')) {
+        for (i = 1; i < sizeof(glyphs) / sizeof(glyphs[0]); ++i)
+            if (strlen(glyphs[i]) == token->len &&
+                !memcmp(glyphs[i], token->text, token->len))
+                return i;
+        return 0;
+    }
+
+    for (i = 0; i < token->len; ++i)
+        code = code * 10 + token->text[i] - '0';
+
+    return code > 255 ? 0 : code;
+}
+
+/*
+ * input: comments - list to append to
+ *        arena - where to allocate
+ *        token - token_comment
+ * output: return success/failed (out of memory)
+ */
+static reader_result_t
+add_comment(pgn_comment_t **comments, arena_t *arena, const pgn_token_t *token)
+{
+    pgn_comment_t *comment = arena_alloc(arena, sizeof(*comment));
+
+    if (NULL == comment) return failed;
+    comment->text = token->text;
+    comment->len = token->len;
+    comment->next = NULL;
+
+    while (*comments) comments = &(*comments)->next;
+    *comments = comment;
+    return success;
+}
+
+/*
+ * input: tree - tree to fill
+ *        arena - where nodes are allocated, movetext must outlive it too
+ *        movetext - movetext of the game (not null-terminated)
+ *        len - size of movetext
+ * output: return success/failed (out of memory)
+ *         tree - moves, variations, comments and NAGs of the game,
+ *                text of them points into movetext
+ */
+reader_result_t
+pgn_tree_parse(pgn_tree_t *tree, arena_t *arena,
+               const char *movetext, int len)
+{
+    pgn_lexer_t lexer;
+    pgn_token_t token;
+    pgn_line_t lines[PGN_TREE_DEPTH];
+    pgn_line_t *line;
+    pgn_move_t *move;
+    pgn_move_t *alternative;
+    pgn_comment_t **comments;
+    int depth = 0;
+    // variations nested too deep to be kept
+    int skipped = 0;
+    int move_nr = 1;
+    int black = 0;
+    int dots;
+    unsigned char code;
+    int i;
+
+    memset(tree, 0, sizeof(*tree));
+    tree->result = movetext + len;
+
+    line = &lines[0];
+    line->last = NULL;
+    line->first = &tree->mainline;
+    line->alternative = NULL;
+    line->pending = NULL;
+
+    pgn_lexer_init(&lexer, movetext, len);
+    while (pgn_lexer_next(&lexer, &token) != token_end) {
+        if (skipped) {
+            if (token.type == token_rav_open) ++skipped;
+            if (token.type == token_rav_close) --skipped;
+            continue;
+        }
+
+        switch (token.type) {
+            case token_move_number :
+                move_nr = 0;
+                for (i = 0; i < token.len; ++i)
+                    move_nr = move_nr * 10 + token.text[i] - '0';
+                // "12..." is followed by black move, "12." by white one
+                dots = lexer.pos - (token.text - movetext) - token.len;
+                black = dots > 1;
+                break;
+
+            case token_san :
+                move = arena_alloc(arena, sizeof(*move));
+                if (NULL == move) return failed;
+                memset(move, 0, sizeof(*move));
+                move->san = token.text;
+                move->san_len = token.len > 255 ? 255 : token.len;
+                move->shown_len = move->san_len;
+                move->black = black;
+                move->move_nr = move_nr;
+
+                if (line->last) {
+                    line->last->next = move;
+                } else {
+                    *line->first = move;
+                    move->comments = line->pending;
+                }
+                line->last = move;
+
+                if (black) ++move_nr;
+                black = !black;
+                if (depth == 0) ++tree->moves_nr;
+                break;
+
+            case token_nag :
+                if (NULL == line->last) break;
+                move = line->last;
+                // glyph right after SAN is shown with it
+                if (token.text == move->san + move->shown_len &&
+                    move->shown_len + token.len <= 255)
+                    move->shown_len += token.len;
+                code = nag_code(&token);
+                if (code && move->nags_nr < PGN_MOVE_NAGS)
+                    move->nags[move->nags_nr++] = code;
+                break;
+
+            case token_comment :
+                if (line->last)
+                    comments = &line->last->comments;
+                else if (depth == 0)
+                    comments = &tree->comments;
+                else
+                    comments = &line->pending;
+
+                if (add_comment(comments, arena, &token) == failed)
+                    return failed;
+                break;
+
+            case token_rav_open :
+                alternative = line->last;
+                if (NULL == alternative || depth + 1 == PGN_TREE_DEPTH) {
+                    skipped = 1;
+                    break;
+                }
+
+                ++depth;
+                line = &lines[depth];
+                line->last = NULL;
+                line->alternative = alternative;
+                line->first = &alternative->variations;
+                while (*line->first) line->first = &(*line->first)->next_variation;
+                line->pending = NULL;
+
+                // variation replays the move it is alternative to
+                move_nr = alternative->move_nr;
+                black = alternative->black;
+                break;
+
+            case token_rav_close :
+                if (depth == 0) break;
+                alternative = line->alternative;
+                --depth;
+                line = &lines[depth];
+
+                // continue after the move variation was alternative to
+                move_nr = alternative->move_nr + alternative->black;
+                black = !alternative->black;
+                break;
+
+            case token_result :
+                if (depth) break;
+                tree->result = token.text;
+                tree->result_len = token.len;
+                return success;
+
+            default :
+                break;
+        }
+    }
+
+    return success;
+}
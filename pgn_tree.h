@@ -0,0 +1,55 @@
+#ifndef PGN_TREE_H
+#define PGN_TREE_H
+
+#include "arena.h"
+#include "pgn_lexer.h"
+#include "pgn_reader.h"
+
+// NAG codes stored per move, more are dropped
+#define PGN_MOVE_NAGS 4
+
+// comment text as it is in movetext
+typedef struct pgn_comment_s {
+    const char *text;
+    int len;
+    struct pgn_comment_s *next;
+} pgn_comment_t;
+
+// one move of game tree
+typedef struct pgn_move_s {
+    // SAN as it is in movetext
+    const char *san;
+    unsigned char san_len;
+    // with annotation glyph written right after SAN (like "e4!")
+    unsigned char shown_len;
+    // moving as blacks? (bit 0)
+    unsigned char black;
+    unsigned char nags_nr;
+    unsigned char nags[PGN_MOVE_NAGS];
+    int move_nr;
+    // comments following the move (and leading variation it starts)
+    pgn_comment_t *comments;
+    // next move of the same line
+    struct pgn_move_s *next;
+    // first moves of variations played instead of this move
+    struct pgn_move_s *variations;
+    // next variation played instead of the same move
+    struct pgn_move_s *next_variation;
+} pgn_move_t;
+
+// movetext of game: mainline with variations hanging off its moves
+typedef struct {
+    pgn_move_t *mainline;
+    // comments before the first move
+    pgn_comment_t *comments;
+    // game termination marker, empty if there is none
+    const char *result;
+    int result_len;
+    int moves_nr;
+} pgn_tree_t;
+
+reader_result_t
+pgn_tree_parse(pgn_tree_t *tree, arena_t *arena,
+               const char *movetext, int len);
+
+#endif